@@ -9,9 +9,15 @@ Rectangle {
     property var subregionSelectionChangedCallback;
     property var onRestart;
     property var onCalculate;
+    property var onCancel;
+    property bool calculating;
+    property double calculationProgress;
+    property string calculationPhase;
 
     property bool showBetaVectorField: showBetaVectorFieldCheckbox.checked;
     property bool showTriangulation: showTriangulationCheckbox.checked;
+    property string colormap: colormapComboBox.currentText
+    property string colorGamma: colorGammaTextField.text
     property bool calculateGamma2: calculateGamma2CheckBox.checked;
     property string windX: windDirectionX.text;
     property string windY: windDirectionY.text;
@@ -125,6 +131,36 @@ Rectangle {
                 }
             }
 
+            GroupBox {
+                title: qsTr("Colors")
+                padding: 9
+                leftPadding: 3
+                Layout.fillWidth: true
+                Layout.leftMargin: 6
+                Layout.topMargin: 8
+                ColumnLayout {
+                    anchors.fill: parent
+                    ComboBox {
+                        id: colormapComboBox
+                        model: ["grayscale", "heat", "viridis"]
+                        Layout.leftMargin: 6
+                        Layout.fillWidth: true
+                    }
+                    Text {
+                        text: qsTr("Gamma:")
+                        Layout.leftMargin: 11
+                    }
+                    TextField {
+                        id: colorGammaTextField
+                        text: "1"
+                        placeholderText: qsTr("Gamma")
+                        Layout.leftMargin: 6
+                        Layout.fillWidth: true
+                        validator: DoubleValidator { bottom: 0.01 }
+                    }
+                }
+            }
+
             CheckBox {
                 id: calculateGamma2CheckBox
                 Layout.topMargin: 15
@@ -195,13 +231,34 @@ Rectangle {
 
             Button {
                 text: qsTr("Calculate")
-                enabled: readyToCalculate
+                enabled: readyToCalculate && !calculating
                 Layout.leftMargin: 6
                 Layout.fillWidth: true
                 onClicked: {
                     onCalculate();
                 }
             }
+
+            Text {
+                text: calculationPhase
+                visible: calculating
+                Layout.leftMargin: 6
+            }
+            ProgressBar {
+                value: calculationProgress
+                visible: calculating
+                Layout.leftMargin: 6
+                Layout.fillWidth: true
+            }
+            Button {
+                text: qsTr("Cancel")
+                visible: calculating
+                Layout.leftMargin: 6
+                Layout.fillWidth: true
+                onClicked: {
+                    onCancel();
+                }
+            }
         }
     }
 }
@@ -1,4 +1,4 @@
-QT += quick location
+QT += quick location concurrent
 
 CONFIG += c++11
 
@@ -16,8 +16,15 @@ DEFINES += QT_DEPRECATED_WARNINGS
 SOURCES += \
         calculationresult_component.cpp \
         integral_calculation.cpp \
+        integral_calculation_adaptive.cpp \
+        integral_calculation_cache.cpp \
+        integral_calculation_kernel.cpp \
+        integral_calculation_lod.cpp \
+        integral_calculation_solvers.cpp \
+        integral_calculation_trace.cpp \
         integral_calculation_utils.cpp \
         main.cpp \
+        message_log_sink.cpp \
         triangle_gradient_renderer.cpp \
         triangulate.cpp
 
@@ -37,7 +44,15 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 HEADERS += \
     calculationresult_component.h \
     integral_calculation.h \
+    integral_calculation_adaptive.h \
+    integral_calculation_cache.h \
+    integral_calculation_elements.h \
+    integral_calculation_kernel.h \
+    integral_calculation_lod.h \
+    integral_calculation_solvers.h \
+    integral_calculation_trace.h \
     integral_calculation_utils.h \
+    message_log_sink.h \
     triangle_gradient_renderer.h \
     triangulate.h
 
@@ -53,3 +68,13 @@ DISTFILES += \
 CONFIG(debug, debug|release) {
     DEFINES += INTCALC_DEBUG=1
 }
+
+# chrome trace of the solve stages, qmake CONFIG+=intcalc_trace
+intcalc_trace {
+    DEFINES += INTCALC_TRACE=1
+}
+
+# quadratic elements instead of linear ones, qmake CONFIG+=intcalc_p2
+intcalc_p2 {
+    DEFINES += INTCALC_P2=1
+}
@@ -0,0 +1,56 @@
+# headless scenario runner, only needs the calculation sources
+
+QT -= gui
+QT += concurrent
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = intcalc_batch
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += $$PWD/..
+
+SOURCES += \
+        main.cpp \
+        batch_scenario.cpp \
+        ../integral_calculation.cpp \
+        ../integral_calculation_adaptive.cpp \
+        ../integral_calculation_cache.cpp \
+        ../integral_calculation_kernel.cpp \
+        ../integral_calculation_solvers.cpp \
+        ../integral_calculation_trace.cpp \
+        ../integral_calculation_utils.cpp \
+        ../triangulate.cpp
+
+HEADERS += \
+    batch_scenario.h \
+    ../integral_calculation.h \
+    ../integral_calculation_adaptive.h \
+    ../integral_calculation_cache.h \
+    ../integral_calculation_elements.h \
+    ../integral_calculation_kernel.h \
+    ../integral_calculation_solvers.h \
+    ../integral_calculation_trace.h \
+    ../integral_calculation_utils.h \
+    ../triangulate.h
+
+unix:!macx: LIBS += -L$$PWD/../../triangle-lib/ -ltriangle
+
+INCLUDEPATH += $$PWD/../../triangle-lib
+DEPENDPATH += $$PWD/../../triangle-lib
+
+CONFIG(debug, debug|release) {
+    DEFINES += INTCALC_DEBUG=1
+}
+
+# chrome trace of the solve stages, qmake CONFIG+=intcalc_trace
+intcalc_trace {
+    DEFINES += INTCALC_TRACE=1
+}
+
+# quadratic elements instead of linear ones, qmake CONFIG+=intcalc_p2
+intcalc_p2 {
+    DEFINES += INTCALC_P2=1
+}
@@ -0,0 +1,238 @@
+#include "batch_scenario.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QTextStream>
+
+namespace intcalc_batch {
+    namespace {
+        QVector<intcalc::Vector2d> readPoints(const QJsonValue& value, int minPoints, bool closed) {
+            const QJsonArray array = value.toArray();
+            QVector<intcalc::Vector2d> points;
+            points.reserve(array.size() + 1);
+            for (const QJsonValue& point : array) {
+                const QJsonArray xy = point.toArray();
+                if (xy.size() != 2 || !xy[0].isDouble() || !xy[1].isDouble()) {
+                    throw "Invalid point, expected [x, y]";
+                }
+                points.push_back(intcalc::Vector2d(xy[0].toDouble(), xy[1].toDouble()));
+            }
+            if (points.size() < minPoints) {
+                throw "Invalid path size";
+            }
+
+            // regions are closed by repeating the first point, same as the map polygons
+            if (closed && (points.first().x != points.last().x || points.first().y != points.last().y)) {
+                points.push_back(points.first());
+            }
+            return points;
+        }
+
+        QVector<QVector<intcalc::Vector2d>> readRegions(const QJsonValue& value) {
+            QVector<QVector<intcalc::Vector2d>> regions;
+            for (const QJsonValue& region : value.toArray()) {
+                regions.push_back(readPoints(region, 3, true));
+            }
+            return regions;
+        }
+
+        intcalc::ParameterSet readParameterSet(const QJsonObject& object) {
+            const QJsonArray beta = object.value("beta").toArray();
+            if (!object.value("mu").isDouble()
+                    || !object.value("sigma").isDouble()
+                    || !object.value("alpha").isDouble()
+                    || (!beta.isEmpty() && beta.size() != 2)) {
+                throw "Invalid parameters, expected mu, sigma, alpha and optional beta [x, y]";
+            }
+            return intcalc::ParameterSet(object.value("mu").toDouble(),
+                                         object.value("sigma").toDouble(),
+                                         object.value("alpha").toDouble(),
+                                         beta.isEmpty() ? 0.0 : beta[0].toDouble(),
+                                         beta.isEmpty() ? 0.0 : beta[1].toDouble());
+        }
+
+        QJsonObject pointToJson(const intcalc::Point2DValue& point) {
+            QJsonObject object;
+            object.insert("x", point.x);
+            object.insert("y", point.y);
+            object.insert("value", point.value);
+            return object;
+        }
+    }
+
+    Scenario readScenario(const QString& fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            throw "Can't open scenario file";
+        }
+
+        QJsonParseError parseError;
+        const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+        if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+            throw "Scenario file is not a valid JSON object";
+        }
+        const QJsonObject root = document.object();
+
+        Scenario scenario;
+        scenario.name = root.value("name").toString(QFileInfo(fileName).completeBaseName());
+        scenario.regionOfStudy = readPoints(root.value("regionOfStudy"), 3, true);
+        if (root.contains("gamma2")) {
+            scenario.gamma2 = readPoints(root.value("gamma2"), 2, false);
+        }
+        scenario.conservacyAreas = readRegions(root.value("conservacyAreas"));
+        scenario.polutionSourceRegions = readRegions(root.value("polutionSourceRegions"));
+
+        const QJsonObject triangulation = root.value("triangulation").toObject();
+        scenario.triMinAngle = triangulation.value("minAngle").toDouble(20);
+        scenario.triMaxArea = triangulation.value("maxArea").toDouble(0.0001);
+
+        if (root.contains("adaptive")) {
+            const QJsonObject adaptive = root.value("adaptive").toObject();
+            scenario.adaptive.maxIterations = adaptive.value("maxIterations").toInt(5);
+            scenario.adaptive.tolerance = adaptive.value("tolerance").toDouble(scenario.adaptive.tolerance);
+            scenario.adaptive.maxVertices = adaptive.value("maxVertices").toInt(scenario.adaptive.maxVertices);
+            scenario.adaptive.markingFraction = adaptive.value("markingFraction").toDouble(scenario.adaptive.markingFraction);
+            if (scenario.adaptive.markingFraction <= 0 || scenario.adaptive.markingFraction > 1) {
+                throw "Invalid adaptive refinement, markingFraction has to be in (0, 1]";
+            }
+        }
+
+        if (root.contains("parameterSets")) {
+            for (const QJsonValue& parameters : root.value("parameterSets").toArray()) {
+                scenario.parameterSets.push_back(readParameterSet(parameters.toObject()));
+            }
+        } else {
+            scenario.parameterSets.push_back(readParameterSet(root));
+        }
+        if (scenario.parameterSets.isEmpty()) {
+            throw "Scenario has no parameter sets";
+        }
+        return scenario;
+    }
+
+    ScenarioResult runScenario(Scenario& scenario, bool computeAreaFields) {
+        ScenarioResult result;
+        result.name = scenario.name;
+        result.parameterSets = scenario.parameterSets;
+
+        QElapsedTimer timer;
+        timer.start();
+        try {
+            QVector<QVector<intcalc::Vector2d>*> conservacyAreasPoints;
+            for (auto& area : scenario.conservacyAreas) {
+                conservacyAreasPoints.push_back(&area);
+            }
+            QVector<QVector<intcalc::Vector2d>*> polutionSourceRegionsPoints;
+            for (auto& region : scenario.polutionSourceRegions) {
+                polutionSourceRegionsPoints.push_back(&region);
+            }
+
+            intcalc::FEMCalculator femCalculator;
+            femCalculator.setRegionOfStudy(&scenario.regionOfStudy);
+            if (!scenario.gamma2.isEmpty()) {
+                femCalculator.setGamma2(&scenario.gamma2);
+            }
+            femCalculator.setConservacyAreas(conservacyAreasPoints);
+            femCalculator.setPolutionSourceRegions(polutionSourceRegionsPoints);
+            femCalculator.setTriangulationOptions(scenario.triMinAngle, scenario.triMaxArea);
+            femCalculator.setComputeAreaFields(computeAreaFields);
+            femCalculator.setAdaptiveRefinement(scenario.adaptive);
+            // scenarios already run in parallel, one core per scenario
+            femCalculator.setAssemblyThreads(1);
+
+            if (scenario.parameterSets.size() == 1) {
+                const intcalc::ParameterSet& parameters = scenario.parameterSets.first();
+                femCalculator.setMu(parameters.mu);
+                femCalculator.setSigma(parameters.sigma);
+                femCalculator.setAlpha(parameters.alpha);
+                femCalculator.setBeta(parameters.betaX, parameters.betaY);
+                result.solutions.push_back(femCalculator.solve());
+            } else {
+                result.solutions = femCalculator.solveBatch(scenario.parameterSets);
+            }
+        } catch (const char* e) {
+            result.error = e;
+        }
+        result.time = timer.elapsed();
+        return result;
+    }
+
+    void writeResult(const ScenarioResult& result, const QString& outputDir, bool writeFields) {
+        QDir dir(outputDir);
+
+        QJsonArray solutions;
+        for (int i = 0; i < result.solutions.size(); i++) {
+            const intcalc::CalcSolution& solution = result.solutions[i];
+            const intcalc::ParameterSet& parameters = result.parameterSets[i];
+
+            QJsonObject object;
+            object.insert("mu", parameters.mu);
+            object.insert("sigma", parameters.sigma);
+            object.insert("alpha", parameters.alpha);
+            object.insert("beta", QJsonArray({ parameters.betaX, parameters.betaY }));
+            object.insert("vertices", solution.data->verticesCount());
+            object.insert("triangles", solution.data->trianglesCount());
+            object.insert("solver", solution.solverReport.solverName);
+            object.insert("iterations", solution.solverReport.iterations);
+            object.insert("converged", solution.solverReport.converged);
+            object.insert("metrics", solution.metrics.toJson());
+
+            QJsonArray minVertices;
+            for (const intcalc::Point2DValue& minVertex : solution.minVertices) {
+                minVertices.push_back(pointToJson(minVertex));
+            }
+            object.insert("minVertices", minVertices);
+            solutions.push_back(object);
+
+            if (!writeFields) {
+                continue;
+            }
+            QSaveFile fieldsFile(dir.filePath(QString("%1_%2.csv").arg(result.outputName).arg(i)));
+            if (!fieldsFile.open(QIODevice::WriteOnly)) {
+                throw "Can't write fields file";
+            }
+            QTextStream stream(&fieldsFile);
+            stream.setRealNumberPrecision(17);
+            stream << "x,y,value";
+            for (int area = 0; area < solution.areaFields.size(); area++) {
+                stream << ",area" << area;
+            }
+            stream << "\n";
+            const intcalc::SolutionData& data = *solution.data;
+            for (int vertex = 0; vertex < data.verticesCount(); vertex++) {
+                stream << data.x(vertex) << "," << data.y(vertex) << "," << data.values[vertex];
+                for (const QVector<double>& field : solution.areaFields) {
+                    stream << "," << field[vertex];
+                }
+                stream << "\n";
+            }
+            stream.flush();
+            if (!fieldsFile.commit()) {
+                throw "Can't write fields file";
+            }
+        }
+
+        QJsonObject root;
+        root.insert("name", result.name);
+        root.insert("time", result.time);
+        if (!result.error.isEmpty()) {
+            root.insert("error", result.error);
+        }
+        root.insert("solutions", solutions);
+
+        QSaveFile resultFile(dir.filePath(result.outputName + ".json"));
+        if (!resultFile.open(QIODevice::WriteOnly)) {
+            throw "Can't write result file";
+        }
+        resultFile.write(QJsonDocument(root).toJson());
+        if (!resultFile.commit()) {
+            throw "Can't write result file";
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef BATCH_SCENARIO_H
+#define BATCH_SCENARIO_H
+
+#include <QString>
+#include <QVector>
+
+#include "integral_calculation.h"
+
+namespace intcalc_batch {
+    // one scenario file, e.g.
+    // {
+    //     "regionOfStudy": [[x, y], ...],
+    //     "gamma2": [[x, y], ...],
+    //     "conservacyAreas": [[[x, y], ...], ...],
+    //     "polutionSourceRegions": [[[x, y], ...], ...],
+    //     "triangulation": { "minAngle": 20, "maxArea": 0.01 },
+    //     "adaptive": { "maxIterations": 5, "tolerance": 0.05, "maxVertices": 200000, "markingFraction": 0.5 },
+    //     "mu": 1, "sigma": 1, "alpha": 1, "beta": [0, 0]
+    // }
+    // instead of the single parameter set a "parameterSets" array of objects
+    // with mu, sigma, alpha and beta can be given, gamma 2, the areas and
+    // the adaptive refinement of single parameter sets are optional
+    struct Scenario {
+        QString name;
+        QVector<intcalc::Vector2d> regionOfStudy;
+        QVector<intcalc::Vector2d> gamma2;
+        QVector<QVector<intcalc::Vector2d>> conservacyAreas;
+        QVector<QVector<intcalc::Vector2d>> polutionSourceRegions;
+        double triMinAngle;
+        double triMaxArea;
+        intcalc::AdaptiveRefinementOptions adaptive;
+        QVector<intcalc::ParameterSet> parameterSets;
+    };
+
+    struct ScenarioResult {
+        QString name;
+        // base name of the result files, the base name of the scenario file
+        QString outputName;
+        // empty if the scenario was solved
+        QString error;
+        QVector<intcalc::ParameterSet> parameterSets;
+        QVector<intcalc::CalcSolution> solutions;
+        qint64 time;
+
+        ScenarioResult()
+            : time(0) {
+        }
+    };
+
+    // throws a const char* if the file can't be read or is not a valid scenario
+    Scenario readScenario(const QString& fileName);
+
+    // never throws, errors end up in ScenarioResult::error
+    ScenarioResult runScenario(Scenario& scenario, bool computeAreaFields);
+
+    // <outputName>.json with the min vertices and solver reports of every parameter set,
+    // with writeFields also <outputName>_<index>.csv with the value in every vertex
+    void writeResult(const ScenarioResult& result, const QString& outputDir, bool writeFields);
+}
+
+#endif // BATCH_SCENARIO_H
@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QSet>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QtConcurrent>
+
+#include "batch_scenario.h"
+#include "integral_calculation_trace.h"
+
+// headless runner for scenario files, see intcalc_batch::Scenario for the format
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("intcalc_batch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Solves scenario files in parallel and writes the results to a directory.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("scenarios", "Scenario files or directories with *.json scenario files.", "scenarios...");
+    QCommandLineOption outputOption({ "o", "output" }, "Directory for the results.", "dir", ".");
+    QCommandLineOption threadsOption({ "j", "threads" }, "Scenarios solved at once, all cores by default.", "n");
+    QCommandLineOption fieldsOption("fields", "Write the value in every vertex as CSV.");
+    QCommandLineOption areaFieldsOption("area-fields", "Solve for every conservation area separately as well.");
+    QCommandLineOption verboseOption({ "v", "verbose" }, "Print the log of every solve.");
+    parser.addOptions({ outputOption, threadsOption, fieldsOption, areaFieldsOption, verboseOption });
+    parser.process(app);
+
+    if (!parser.isSet(verboseOption)) {
+        QLoggingCategory::setFilterRules("default.info=false");
+    }
+
+    QStringList files;
+    for (const QString& argument : parser.positionalArguments()) {
+        QFileInfo info(argument);
+        if (info.isDir()) {
+            QDir dir(argument);
+            for (const QString& name : dir.entryList({ "*.json" }, QDir::Files, QDir::Name)) {
+                files.push_back(dir.filePath(name));
+            }
+        } else {
+            files.push_back(argument);
+        }
+    }
+    if (files.isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    // the results are named after the scenario files, two files with the
+    // same base name would overwrite each other's results
+    QSet<QString> outputNames;
+    for (const QString& fileName : files) {
+        const QString outputName = QFileInfo(fileName).completeBaseName();
+        if (outputNames.contains(outputName)) {
+            qCritical() << "More than one scenario file named" << outputName;
+            return 1;
+        }
+        outputNames.insert(outputName);
+    }
+
+    const QString outputDir = parser.value(outputOption);
+    if (!QDir().mkpath(outputDir)) {
+        qCritical() << "Can't create output directory" << outputDir;
+        return 1;
+    }
+    if (parser.isSet(threadsOption)) {
+        QThreadPool::globalInstance()->setMaxThreadCount(std::max(parser.value(threadsOption).toInt(), 1));
+    }
+
+    const bool writeFields = parser.isSet(fieldsOption);
+    const bool computeAreaFields = parser.isSet(areaFieldsOption);
+    QMutex outputMutex;
+    QTextStream out(stdout);
+    int failed = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    QtConcurrent::blockingMap(files, [&](const QString& fileName) {
+        intcalc_batch::ScenarioResult result;
+        try {
+            intcalc_batch::Scenario scenario = intcalc_batch::readScenario(fileName);
+            result = intcalc_batch::runScenario(scenario, computeAreaFields);
+        } catch (const char* e) {
+            result.name = QFileInfo(fileName).completeBaseName();
+            result.error = e;
+        }
+        result.outputName = QFileInfo(fileName).completeBaseName();
+
+        try {
+            intcalc_batch::writeResult(result, outputDir, writeFields);
+        } catch (const char* e) {
+            result.error = e;
+        }
+
+        QMutexLocker locker(&outputMutex);
+        if (!result.error.isEmpty()) {
+            failed++;
+            out << fileName << ": " << result.error << "\n";
+        } else {
+            out << fileName << ": solved in " << result.time << " ms\n";
+        }
+        out.flush();
+    });
+
+    INTCALC_TRACE_FINISH();
+    out << files.size() - failed << " of " << files.size() << " scenarios solved in "
+        << timer.elapsed() << " ms\n";
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <math.h>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QProcess>
+#include <QTextStream>
+
+#include "integral_calculation.h"
+#include "integral_calculation_kernel.h"
+#include "integral_calculation_trace.h"
+
+// Times the stages of FEMCalculator::solve on synthetic regions of growing
+// contour complexity and decreasing max triangle area, and the element kernel
+// on its own. The result is a JSON document on stdout (or --output), meant to
+// be compared between versions. Every case runs in a child process started
+// with --case, so its peak memory is not that of the cases before it.
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    // closed star shaped contour with the given amount of vertices
+    QVector<intcalc::Vector2d> polygon(double cx, double cy, double radius, int vertices) {
+        QVector<intcalc::Vector2d> points;
+        for (int i = 0; i < vertices; i++) {
+            const double angle = 2 * PI * i / vertices;
+            const double r = radius * (1 + 0.1 * sin(7 * angle));
+            points.push_back(intcalc::Vector2d(cx + r * cos(angle), cy + r * sin(angle)));
+        }
+        points.push_back(points.first());
+        return points;
+    }
+
+    double median(QVector<double> values) {
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    QJsonObject stage(const QVector<double>& times, const intcalc::SolveMetrics& metrics) {
+        const double ms = median(times);
+        QJsonObject object;
+        object.insert("ms", ms);
+        object.insert("trianglesPerSecond", ms > 0 ? metrics.triangles / ms * 1000 : 0.0);
+        object.insert("verticesPerSecond", ms > 0 ? metrics.vertices / ms * 1000 : 0.0);
+        return object;
+    }
+
+    QJsonObject runCase(int complexity, double maxArea, int threads, int repeat) {
+        QVector<intcalc::Vector2d> regionOfStudy = polygon(0, 0, 1, complexity);
+        // first quarter of the contour is gamma 2
+        QVector<intcalc::Vector2d> gamma2 = regionOfStudy.mid(0, complexity / 4 + 1);
+        QVector<intcalc::Vector2d> area = polygon(0.4, 0.1, 0.2, std::max(complexity / 4, 3));
+        QVector<intcalc::Vector2d> source = polygon(-0.4, -0.1, 0.2, std::max(complexity / 4, 3));
+
+        intcalc::FEMCalculator calculator;
+        calculator.setRegionOfStudy(&regionOfStudy);
+        calculator.setGamma2(&gamma2);
+        calculator.setConservacyAreas({ &area });
+        calculator.setPolutionSourceRegions({ &source });
+        calculator.setTriangulationOptions(20, maxArea);
+        calculator.setMu(1);
+        calculator.setSigma(0.5);
+        calculator.setAlpha(1);
+        calculator.setBeta(0.3, -0.2);
+        calculator.setAssemblyThreads(threads);
+        // every repetition has to triangulate
+        calculator.setUseMeshCache(false);
+
+        QVector<double> triangulation, classification, assembly, solve, extraction, total;
+        intcalc::SolveMetrics metrics;
+        for (int i = 0; i < repeat; i++) {
+            intcalc::CalcSolution solution = calculator.solve();
+            metrics = solution.metrics;
+            triangulation.push_back(metrics.triangulationTime);
+            classification.push_back(metrics.classificationTime);
+            assembly.push_back(metrics.assemblyTime);
+            solve.push_back(metrics.solveTime);
+            extraction.push_back(metrics.extractionTime);
+            total.push_back(metrics.totalTime);
+        }
+
+        QJsonObject stages;
+        stages.insert("triangulation", stage(triangulation, metrics));
+        stages.insert("classification", stage(classification, metrics));
+        stages.insert("assembly", stage(assembly, metrics));
+        stages.insert("solve", stage(solve, metrics));
+        stages.insert("extraction", stage(extraction, metrics));
+
+        QJsonObject result;
+        result.insert("complexity", complexity);
+        result.insert("maxArea", maxArea);
+        result.insert("threads", threads);
+        result.insert("vertices", metrics.vertices);
+        result.insert("triangles", metrics.triangles);
+        result.insert("unknowns", metrics.unknowns);
+        result.insert("nonZeros", static_cast<double>(metrics.nonZeros));
+        result.insert("iterations", metrics.iterations);
+        result.insert("stages", stages);
+        result.insert("totalMs", median(total));
+        // the process ran only this case
+        result.insert("peakMemory", static_cast<double>(metrics.processPeakMemory));
+        return result;
+    }
+
+    QJsonObject runCaseProcess(int index, int complexity, double maxArea, int threads, int repeat) {
+        // every case writes its own trace
+        QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+        const QFileInfo traceFile(environment.value("INTCALC_TRACE_FILE", "intcalc_trace.json"));
+        environment.insert("INTCALC_TRACE_FILE",
+                           traceFile.dir().filePath(QString("%1_case%2.json").arg(traceFile.completeBaseName()).arg(index)));
+
+        QProcess process;
+        process.setProcessEnvironment(environment);
+        process.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+        process.start(QCoreApplication::applicationFilePath(), {
+            "--case", QString("%1,%2,%3").arg(complexity).arg(QString::number(maxArea, 'g', 17)).arg(threads),
+            "--repeat", QString::number(repeat)
+        });
+        if (!process.waitForFinished(-1)
+                || process.exitStatus() != QProcess::NormalExit
+                || process.exitCode() != 0) {
+            throw "Case process failed";
+        }
+
+        const QJsonDocument document = QJsonDocument::fromJson(process.readAllStandardOutput());
+        if (!document.isObject()) {
+            throw "Case process wrote no result";
+        }
+        return document.object();
+    }
+
+    QJsonObject runKernel(int batches) {
+        intcalc::ElementCoefficients coefficients;
+        coefficients.mu = 1;
+        coefficients.sigma = 0.5;
+        coefficients.betaX = 0.3;
+        coefficients.betaY = -0.2;
+
+        QVector<intcalc::ElementBatch> input(64);
+        for (int b = 0; b < input.size(); b++) {
+            for (int e = 0; e < intcalc::ElementBatch::SIZE; e++) {
+                const double shift = 0.001 * (b * intcalc::ElementBatch::SIZE + e);
+                input[b].x[0][e] = shift;
+                input[b].y[0][e] = 0;
+                input[b].x[1][e] = 1 + shift;
+                input[b].y[1][e] = 0.1;
+                input[b].x[2][e] = 0.2;
+                input[b].y[2][e] = 1 + shift;
+            }
+        }
+
+        double checksum = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < batches; i++) {
+            intcalc::ElementBatch& batch = input[i % input.size()];
+            intcalc::computeElementMatrices(batch, coefficients);
+            checksum += batch.m[4][i % intcalc::ElementBatch::SIZE];
+        }
+        const double ms = timer.nsecsElapsed() / 1000000.0;
+
+        QJsonObject result;
+        result.insert("elements", static_cast<double>(batches) * intcalc::ElementBatch::SIZE);
+        result.insert("ms", ms);
+        result.insert("elementsPerSecond", ms > 0 ? batches * intcalc::ElementBatch::SIZE / ms * 1000 : 0.0);
+        // keeps the loop from being optimized away
+        result.insert("checksum", checksum);
+        return result;
+    }
+
+    QVector<double> toNumbers(const QString& list) {
+        QVector<double> numbers;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        const QStringList items = list.split(',', Qt::SkipEmptyParts);
+#else
+        const QStringList items = list.split(',', QString::SkipEmptyParts);
+#endif
+        for (const QString& item : items) {
+            numbers.push_back(item.toDouble());
+        }
+        return numbers;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("intcalc_benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the stages of the FEM pipeline.");
+    parser.addHelpOption();
+    QCommandLineOption complexityOption("complexity", "Contour vertices of the region of study.", "list", "8,32,128,512");
+    QCommandLineOption maxAreaOption("max-area", "Max triangle areas.", "list", "0.01,0.001,0.0001");
+    QCommandLineOption threadsOption("threads", "Assembly threads.", "list", "1");
+    QCommandLineOption repeatOption("repeat", "Solves per case, the median is reported.", "n", "5");
+    QCommandLineOption kernelOption("kernel-batches", "Element batches for the kernel benchmark.", "n", "1000000");
+    QCommandLineOption labelOption("label", "Label stored with the results, e.g. the version.", "label");
+    QCommandLineOption outputOption({ "o", "output" }, "Write the JSON here instead of stdout.", "file");
+    QCommandLineOption caseOption("case", "Run only this case and print its JSON, used for the child processes.",
+                                  "complexity,maxArea,threads");
+    parser.addOptions({ complexityOption, maxAreaOption, threadsOption, repeatOption,
+                        kernelOption, labelOption, outputOption, caseOption });
+    parser.process(app);
+
+    QLoggingCategory::setFilterRules("default.info=false");
+
+    const int repeat = std::max(parser.value(repeatOption).toInt(), 1);
+    if (parser.isSet(caseOption)) {
+        const QVector<double> arguments = toNumbers(parser.value(caseOption));
+        if (arguments.size() != 3) {
+            qCritical() << "Invalid case" << parser.value(caseOption);
+            return 1;
+        }
+        try {
+            const QJsonObject result = runCase(static_cast<int>(arguments[0]), arguments[1],
+                                               static_cast<int>(arguments[2]), repeat);
+            QTextStream(stdout) << QJsonDocument(result).toJson(QJsonDocument::Compact);
+        } catch (const char* e) {
+            qCritical() << "Case" << parser.value(caseOption) << "failed:" << e;
+            return 1;
+        }
+        INTCALC_TRACE_FINISH();
+        return 0;
+    }
+
+    QJsonArray cases;
+    for (double complexity : toNumbers(parser.value(complexityOption))) {
+        for (double maxArea : toNumbers(parser.value(maxAreaOption))) {
+            for (double threads : toNumbers(parser.value(threadsOption))) {
+                try {
+                    cases.push_back(runCaseProcess(cases.size(), static_cast<int>(complexity), maxArea,
+                                                   static_cast<int>(threads), repeat));
+                } catch (const char* e) {
+                    qCritical() << "Case" << complexity << maxArea << threads << "failed:" << e;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    QJsonObject root;
+    root.insert("label", parser.value(labelOption));
+    root.insert("repeat", repeat);
+    root.insert("kernel", runKernel(parser.value(kernelOption).toInt()));
+    root.insert("cases", cases);
+    const QByteArray json = QJsonDocument(root).toJson();
+
+    if (!parser.isSet(outputOption)) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+    QFile file(parser.value(outputOption));
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        qCritical() << "Can't write" << file.fileName();
+        return 1;
+    }
+    return 0;
+}
@@ -1,142 +1,315 @@
 #include "calculationresult_component.h"
 #include "triangle_gradient_renderer.h"
 
+#include <QFile>
+#include <QJsonDocument>
+#include <QtConcurrent>
+
+namespace {
+    // the coarsest level still has about this many triangles,
+    // smaller solutions are always drawn in full
+    const int LOD_MIN_TRIANGLES = 10000;
+}
+
 QQuickFramebufferObject::Renderer* CalculationResultComponent::createRenderer() const {
-    return new TriangleGradientRenderer(vertices, colors, indices, _showTriangulation, dataChanged);
+    return new TriangleGradientRenderer();
 }
 
-QVector<intcalc::Vector2d>* retrievePointsFromMapPolyline(QVariant path, int minPoints) {
+QVector<intcalc::Vector2d> retrievePointsFromMapPolyline(QVariant path, int minPoints) {
     QList<QVariant> pathElements = path.toList();
     if (pathElements.size() < minPoints) {
         throw "Invalid path size";
     }
 
-    QVector<intcalc::Vector2d>* points = new QVector<intcalc::Vector2d>();
+    QVector<intcalc::Vector2d> points;
+    points.reserve(pathElements.size());
     for (auto pathElement : pathElements) {
         QGeoCoordinate coordinate = pathElement.value<QGeoCoordinate>();
-        points->push_back(intcalc::Vector2d(coordinate.longitude(), coordinate.latitude()));
+        points.push_back(intcalc::Vector2d(coordinate.longitude(), coordinate.latitude()));
     }
     return points;
 }
 
-QVariant CalculationResultComponent::doCalculate() {
-    QVector<intcalc::Vector2d>* inputPoints = retrievePointsFromMapPolyline(_regionOfStudy->property("path"), 3);
-    QVector<intcalc::Vector2d>* gamma2 = retrievePointsFromMapPolyline(_gamma2->property("path"), 2);
-    QVector<QVector<intcalc::Vector2d>*> conservacyAreas;
+QVariant minPointsToVariant(const intcalc::CalcSolution& solution) {
+    QList<QGeoCoordinate> resCoords;
+    for (auto minVertex : solution.minVertices) {
+        double longitude = minVertex.x;
+        double latitude = minVertex.y;
+        resCoords.push_back(QGeoCoordinate(latitude, longitude));
+    }
+    qInfo() << "Min points: " << resCoords.size();
+    return QVariant::fromValue(resCoords);
+}
+
+QString phaseName(intcalc::FEMCalculator::Phase phase) {
+    switch (phase) {
+    case intcalc::FEMCalculator::Phase::TRIANGULATION:
+        return "Triangulation";
+    case intcalc::FEMCalculator::Phase::ASSEMBLY:
+        return "Assembly";
+    case intcalc::FEMCalculator::Phase::SOLVE:
+        return "Solving";
+    default:
+        return "Preparing result";
+    }
+}
+
+CalculationResultComponent::CalculationInput CalculationResultComponent::readCalculationInput() {
+    CalculationInput input;
+    input.regionOfStudy = retrievePointsFromMapPolyline(_regionOfStudy->property("path"), 3);
+    input.gamma2 = retrievePointsFromMapPolyline(_gamma2->property("path"), 2);
     int areaCount = _conservacyAreas.property("length").toInt();
     for (int i = 0; i < areaCount; i++) {
         QVariant path = _conservacyAreas.property(i).property("path").toVariant();
-        conservacyAreas.push_back(retrievePointsFromMapPolyline(path, 3));
+        input.conservacyAreas.push_back(retrievePointsFromMapPolyline(path, 3));
     }
 
-    QVector<QVector<intcalc::Vector2d>*> polutionSourceRegions;
     int regionsCount = _polutionSourceRegions.property("length").toInt();
     for (int i = 0; i < regionsCount; i++) {
         QVariant path = _polutionSourceRegions.property(i).property("path").toVariant();
-        polutionSourceRegions.push_back(retrievePointsFromMapPolyline(path, 3));
+        input.polutionSourceRegions.push_back(retrievePointsFromMapPolyline(path, 3));
+    }
+
+    input.calculateGamma2 = _calculateGamma2;
+    input.triMinAngle = _triMinAngle;
+    input.triMaxArea = _triMaxArea;
+    input.windX = _windX;
+    input.windY = _windY;
+    input.mu = _mu;
+    input.sigma = _sigma;
+    input.alpha = _alpha;
+    return input;
+}
+
+intcalc::CalcSolution CalculationResultComponent::runCalculation(CalculationInput& input,
+                                                                 const std::atomic<bool>* cancelled,
+                                                                 intcalc::FEMCalculator::ProgressCallback progressCallback) {
+    // the calculator only keeps pointers to the regions,
+    // the points in input outlive the solve
+    QVector<QVector<intcalc::Vector2d>*> conservacyAreasPoints;
+    for (auto& area : input.conservacyAreas) {
+        conservacyAreasPoints.push_back(&area);
+    }
+    QVector<QVector<intcalc::Vector2d>*> polutionSourceRegionsPoints;
+    for (auto& region : input.polutionSourceRegions) {
+        polutionSourceRegionsPoints.push_back(&region);
     }
 
     intcalc::FEMCalculator femCalculator;
-    femCalculator.setRegionOfStudy(inputPoints);
-    if (_calculateGamma2) {
-        femCalculator.setGamma2(gamma2);
-    }
-    femCalculator.setConservacyAreas(conservacyAreas);
-    femCalculator.setPolutionSourceRegions(polutionSourceRegions);
-    femCalculator.setTriangulationOptions(_triMinAngle, _triMaxArea);
-    femCalculator.setMu(_mu);
-    femCalculator.setSigma(_sigma);
-    femCalculator.setAlpha(_alpha);
-    femCalculator.setBeta(_windX, _windY);
+    femCalculator.setRegionOfStudy(&input.regionOfStudy);
+    if (input.calculateGamma2) {
+        femCalculator.setGamma2(&input.gamma2);
+    }
+    femCalculator.setConservacyAreas(conservacyAreasPoints);
+    femCalculator.setPolutionSourceRegions(polutionSourceRegionsPoints);
+    femCalculator.setTriangulationOptions(input.triMinAngle, input.triMaxArea);
+    femCalculator.setMu(input.mu);
+    femCalculator.setSigma(input.sigma);
+    femCalculator.setAlpha(input.alpha);
+    femCalculator.setBeta(input.windX, input.windY);
+    femCalculator.setCancelFlag(cancelled);
+    femCalculator.setProgressCallback(progressCallback);
 
-    QList<QGeoCoordinate> resCoords;
-    try {
-        intcalc::CalcSolution solution = femCalculator.solve();
+    return femCalculator.solve();
+}
 
-        for (auto minVertex : solution.minVertices) {
-            double longitude = minVertex.x;
-            double latitude = minVertex.y;
-            resCoords.push_back(QGeoCoordinate(latitude, longitude));
-        }
+QVariant CalculationResultComponent::doCalculate() {
+    if (_calculating) {
+        qWarning() << "Calculation is already running";
+        return QVariant::fromValue(nullptr);
+    }
 
+    QVariant minPoints;
+    try {
+        CalculationInput input = readCalculationInput();
+        intcalc::CalcSolution solution = runCalculation(input, nullptr, nullptr);
+        minPoints = minPointsToVariant(solution);
         acceptFEMSolution(solution);
-
-        qInfo() << "Min points: " << resCoords.size();
     } catch(const char* e) {
         qCritical() << e;
         return QVariant::fromValue(nullptr);
     }
 
-    // clean resources
-    delete inputPoints;
-    delete gamma2;
-    for (auto area : conservacyAreas) {
-        delete area;
+    return minPoints;
+}
+
+bool CalculationResultComponent::calculateAsync() {
+    if (_calculating) {
+        qWarning() << "Calculation is already running";
+        return false;
     }
 
-    return QVariant::fromValue(resCoords);
+    CalculationInput input;
+    try {
+        input = readCalculationInput();
+    } catch(const char* e) {
+        qCritical() << e;
+        emit calculationFailed(e);
+        return false;
+    }
+
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    _cancelled = cancelled;
+    setCalculating(true);
+    setProgress(0.0, phaseName(intcalc::FEMCalculator::Phase::TRIANGULATION));
+
+    // progress is posted to the GUI thread while the owner is alive, calls
+    // still queued when it is destroyed are dropped with its posted events
+    std::shared_ptr<WorkerLink> link = _workerLink;
+    auto progressCallback = [link](intcalc::FEMCalculator::Phase phase, double phaseProgress) {
+        const double progress = (phase + phaseProgress) / intcalc::FEMCalculator::Phase::PHASES_COUNT;
+        const QString name = phaseName(phase);
+        QMutexLocker locker(&link->mutex);
+        CalculationResultComponent* owner = link->owner;
+        if (owner == nullptr) {
+            return;
+        }
+        QMetaObject::invokeMethod(owner, [owner, progress, name]() {
+            owner->setProgress(progress, name);
+        }, Qt::QueuedConnection);
+    };
+
+    _calculationWatcher->setFuture(QtConcurrent::run([input, cancelled, progressCallback]() mutable {
+        CalculationOutput output;
+        try {
+            output.solution = runCalculation(input, cancelled.get(), progressCallback);
+        } catch(const char* e) {
+            output.error = e;
+        }
+        output.cancelled = *cancelled;
+        return output;
+    }));
+    return true;
+}
+
+void CalculationResultComponent::cancelCalculation() {
+    if (_cancelled) {
+        *_cancelled = true;
+    }
+}
+
+void CalculationResultComponent::onCalculationFinished() {
+    CalculationOutput output = _calculationWatcher->result();
+    _cancelled.reset();
+    setCalculating(false);
+
+    if (output.cancelled) {
+        qInfo() << "Calculation cancelled";
+        emit calculationCancelled();
+        return;
+    }
+    if (!output.error.isEmpty()) {
+        qCritical() << output.error;
+        emit calculationFailed(output.error);
+        return;
+    }
+
+    setProgress(1.0, phaseName(intcalc::FEMCalculator::Phase::RESULT));
+    QVariant minPoints = minPointsToVariant(output.solution);
+    acceptFEMSolution(output.solution);
+    emit calculationFinished(minPoints);
+}
+
+void CalculationResultComponent::setCalculating(bool calculating) {
+    _calculating = calculating;
+    emit calculatingChanged();
+}
+
+void CalculationResultComponent::setProgress(double progress, const QString& phase) {
+    _progress = progress;
+    _progressPhase = phase;
+    emit progressChanged();
 }
 
 void CalculationResultComponent::clear() {
-    vertices->clear();
-    colors->clear();
-    indices->clear();
-    *dataChanged = true;
+    _solutionData.reset();
+    _lodLevels.clear();
     _hasData = false;
+    update();
     emit hasDataChanged();
 }
 
-void CalculationResultComponent::acceptFEMSolution(intcalc::CalcSolution& solution) {
-    if (solution.vertices.size() <= 0) {
+void CalculationResultComponent::setViewBounds(double west, double south, double east, double north) {
+    if (west == east || south == north) {
+        qWarning() << "Empty view bounds";
         return;
     }
-
-    // TODO: instead of goint through all triangulation points
-    // it would be better to go though ROS points
-    intcalc::Point2DValue bottomLeft = solution.vertices[0];
-    intcalc::Point2DValue topRight = solution.vertices[0];
-    for (long i = 0; i < solution.vertices.size(); i++) {
-        if (bottomLeft.x > solution.vertices[i].x) {
-            bottomLeft.x = solution.vertices[i].x;
-        }
-        if (bottomLeft.y > solution.vertices[i].y) {
-            bottomLeft.y = solution.vertices[i].y;
-        }
-        if (topRight.x < solution.vertices[i].x) {
-            topRight.x = solution.vertices[i].x;
-        }
-        if (topRight.y < solution.vertices[i].y) {
-            topRight.y = solution.vertices[i].y;
-        }
-        if (bottomLeft.value > solution.vertices[i].value) {
-            bottomLeft.value = solution.vertices[i].value;
-        }
-        if (topRight.value < solution.vertices[i].value) {
-            topRight.value = solution.vertices[i].value;
-        }
+    if (_hasViewBounds && west == _viewWest && south == _viewSouth && east == _viewEast && north == _viewNorth) {
+        return;
     }
+    _hasViewBounds = true;
+    _viewWest = west;
+    _viewSouth = south;
+    _viewEast = east;
+    _viewNorth = north;
+    update();
+}
 
-    qInfo() << "---Min value: " << bottomLeft.value;
-    qInfo() << "---Max value: " << topRight.value;
+QString CalculationResultComponent::metricsJson() const {
+    return QString::fromUtf8(QJsonDocument(_metrics.toJson()).toJson(QJsonDocument::Compact));
+}
 
-    double xScaler = 2 / (topRight.x - bottomLeft.x);
-    double yScaler = 2 / (topRight.y - bottomLeft.y);
-    double colorScaler = 1 / (topRight.value - bottomLeft.value);
+// with INTCALC_METRICS_FILE set every solve is appended to it as one line of JSON
+void CalculationResultComponent::recordMetrics(const intcalc::SolveMetrics& metrics) {
+    _metrics = metrics;
+    emit metricsChanged();
 
-    vertices->clear();
-    colors->clear();
-    indices->clear();
-    for (auto vertex : solution.vertices) {
-        float x = static_cast<float>((vertex.x - bottomLeft.x) * xScaler - 1);
-        float y = static_cast<float>((vertex.y - bottomLeft.y) * yScaler - 1);
-        float color = static_cast<float>((vertex.value - bottomLeft.value) * colorScaler);
-        *vertices << QVector2D(x, y);
-        *colors << QVector4D(color, color, color, 0.8f);
+    const QString metricsFile = QString::fromLocal8Bit(qgetenv("INTCALC_METRICS_FILE"));
+    if (metricsFile.isEmpty()) {
+        return;
+    }
+    QFile file(metricsFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Can't write metrics to" << metricsFile;
+        return;
     }
-    for (int i = 0; i < solution.triangleIndices.size(); i++) {
-        *indices << solution.triangleIndices[i];
+    file.write(QJsonDocument(metrics.toJson()).toJson(QJsonDocument::Compact));
+    file.write("\n");
+}
+
+void CalculationResultComponent::acceptFEMSolution(intcalc::CalcSolution& solution) {
+    recordMetrics(solution.metrics);
+    if (solution.data->verticesCount() <= 0) {
+        return;
     }
-    *dataChanged = true;
+
+    qInfo() << "---Min value: " << solution.data->minValue;
+    qInfo() << "---Max value: " << solution.data->maxValue;
+
+    // the bounds and the value range are scaled in the shader
+    _solutionData = solution.data;
+    _lodLevels.clear();
+    startLodBuild();
+    _colorRangeMin = solution.data->minValue;
+    _colorRangeMax = solution.data->maxValue;
+    emit colorRangeChanged();
     _hasData = true;
+    update();
     emit hasDataChanged();
 }
+
+// one build at a time, a solution that arrives meanwhile is simplified after it
+void CalculationResultComponent::startLodBuild() {
+    if (!_solutionData || _lodWatcher->isRunning()) {
+        return;
+    }
+    std::shared_ptr<const intcalc::SolutionData> data = _solutionData;
+    _lodSource = data;
+    _lodWatcher->setFuture(QtConcurrent::run([data]() {
+        return intcalc::buildLodLevels(*data, LOD_MIN_TRIANGLES);
+    }));
+}
+
+void CalculationResultComponent::onLodFinished() {
+    if (_lodSource != _solutionData) {
+        _lodSource.reset();
+        startLodBuild();
+        return;
+    }
+    _lodSource.reset();
+    _lodLevels = _lodWatcher->result();
+    if (!_lodLevels.isEmpty()) {
+        qInfo() << "LOD levels: " << _lodLevels.size();
+        update();
+    }
+}
@@ -2,13 +2,18 @@
 #define CALCULATIONRESULTCOMPONENT_H
 
 #include <QQuickFramebufferObject>
+#include <QFutureWatcher>
 #include <QGeoCoordinate>
+#include <QMutex>
 #include <QtGui/qvector2d.h>
 #include <QtGui/qvector3d.h>
 #include <QtGui/qvector4d.h>
 #include <QDebug>
+#include <atomic>
+#include <memory>
 
 #include "integral_calculation.h"
+#include "integral_calculation_lod.h"
 
 class CalculationResultComponent : public QQuickFramebufferObject {
     Q_OBJECT
@@ -26,21 +31,60 @@ class CalculationResultComponent : public QQuickFramebufferObject {
     Q_PROPERTY(double sigma READ sigma WRITE setSigma NOTIFY sigmaChanged)
     Q_PROPERTY(double alpha READ alpha WRITE setAlpha NOTIFY alphaChanged)
     Q_PROPERTY(bool hasData READ hasData NOTIFY hasDataChanged)
+    Q_PROPERTY(bool calculating READ calculating NOTIFY calculatingChanged)
+    Q_PROPERTY(double progress READ progress NOTIFY progressChanged)
+    Q_PROPERTY(QString progressPhase READ progressPhase NOTIFY progressChanged)
+    // times and sizes of the last solve, the keys of intcalc::SolveMetrics::toJson;
+    // processPeakMemory is the peak of the whole application, not of the solve
+    Q_PROPERTY(QVariantMap metrics READ metrics NOTIFY metricsChanged)
+    // colormap of the result, grayscale, heat or viridis
+    Q_PROPERTY(QString colormap READ colormap WRITE setColormap NOTIFY colormapChanged)
+    Q_PROPERTY(double colorGamma READ colorGamma WRITE setColorGamma NOTIFY colorGammaChanged)
+    // values mapped to the ends of the colormap, reset to the
+    // range of the solution when a new one arrives
+    Q_PROPERTY(double colorRangeMin READ colorRangeMin WRITE setColorRangeMin NOTIFY colorRangeChanged)
+    Q_PROPERTY(double colorRangeMax READ colorRangeMax WRITE setColorRangeMax NOTIFY colorRangeChanged)
+    // frames rendered so far, stays the same while nothing changes
+    Q_PROPERTY(int renderCount READ renderCount NOTIFY renderCountChanged)
 
 public:
     CalculationResultComponent()
-        : vertices(new QVector<QVector2D>()),
-          colors(new QVector<QVector4D>()),
-          indices(new QVector<unsigned int>()),
-          dataChanged(new bool(false)),
-          _showTriangulation(new bool(false)),
+        : _showTriangulation(false),
           _regionOfStudy(nullptr),
-          _gamma2(nullptr) {
+          _gamma2(nullptr),
+          _calculationWatcher(new QFutureWatcher<CalculationOutput>(this)),
+          _workerLink(std::make_shared<WorkerLink>()),
+          _calculating(false),
+          _progress(0.0),
+          _lodWatcher(new QFutureWatcher<QVector<intcalc::LodLevel>>(this)),
+          _colormap("grayscale"),
+          _colorGamma(1.0),
+          _colorRangeMin(0.0),
+          _colorRangeMax(1.0),
+          _hasViewBounds(false),
+          _viewWest(0.0),
+          _viewSouth(0.0),
+          _viewEast(0.0),
+          _viewNorth(0.0),
+          _renderCount(0) {
+        _workerLink->owner = this;
+        connect(_calculationWatcher, &QFutureWatcher<CalculationOutput>::finished,
+                this, &CalculationResultComponent::onCalculationFinished);
+        connect(_lodWatcher, &QFutureWatcher<QVector<intcalc::LodLevel>>::finished,
+                this, &CalculationResultComponent::onLodFinished);
+        // the renderer only draws when asked to
+        connect(this, &QQuickItem::visibleChanged, this, &QQuickItem::update);
+        connect(this, &QQuickItem::widthChanged, this, &QQuickItem::update);
+        connect(this, &QQuickItem::heightChanged, this, &QQuickItem::update);
     }
 
+    // a direct factorization can't be cancelled, so a running worker is
+    // not waited for; it finishes on the thread pool with its own copy of
+    // the input and only stops posting progress here
     ~CalculationResultComponent() {
-        delete vertices;
-        delete colors;
+        cancelCalculation();
+        QMutexLocker locker(&_workerLink->mutex);
+        _workerLink->owner = nullptr;
     }
 
     Renderer *createRenderer() const override;
@@ -54,7 +98,7 @@ public:
     }
 
     bool showTriangulation() {
-        return *_showTriangulation;
+        return _showTriangulation;
     }
 
     QObject* regionOfStudy() {
@@ -101,6 +145,62 @@ public:
         return _hasData;
     }
 
+    bool calculating() {
+        return _calculating;
+    }
+
+    double progress() {
+        return _progress;
+    }
+
+    QString progressPhase() {
+        return _progressPhase;
+    }
+
+    QVariantMap metrics() {
+        return _metrics.toVariantMap();
+    }
+
+    QString colormap() {
+        return _colormap;
+    }
+
+    double colorGamma() {
+        return _colorGamma;
+    }
+
+    double colorRangeMin() {
+        return _colorRangeMin;
+    }
+
+    double colorRangeMax() {
+        return _colorRangeMax;
+    }
+
+    int renderCount() {
+        return _renderCount;
+    }
+
+    bool hasViewBounds() const {
+        return _hasViewBounds;
+    }
+
+    // world rectangle covered by the item, in solver coordinates
+    QRectF viewBounds() const {
+        return QRectF(_viewWest, _viewSouth, _viewEast - _viewWest, _viewNorth - _viewSouth);
+    }
+
+    // shared with the renderer, null if there is nothing to draw
+    std::shared_ptr<const intcalc::SolutionData> solutionData() const {
+        return _solutionData;
+    }
+
+    // simplified versions of the solution data, coarser with every level;
+    // empty until they are built in the background or if the solution is small
+    QVector<intcalc::LodLevel> lodLevels() const {
+        return _lodLevels;
+    }
+
     void setTriMinAngle(double minAngle) {
         _triMinAngle = minAngle;
         emit triMinAngleChanged();
@@ -112,8 +212,34 @@ public:
     }
 
     void setShowTriangulation(bool showTriangulation) {
-        *_showTriangulation = showTriangulation;
+        _showTriangulation = showTriangulation;
         emit showTriangulationChanged();
+        update();
+    }
+
+    // the colors are applied in the shader, only a frame is requested
+    void setColormap(const QString& colormap) {
+        _colormap = colormap;
+        emit colormapChanged();
+        update();
+    }
+
+    void setColorGamma(double colorGamma) {
+        _colorGamma = colorGamma;
+        emit colorGammaChanged();
+        update();
+    }
+
+    void setColorRangeMin(double colorRangeMin) {
+        _colorRangeMin = colorRangeMin;
+        emit colorRangeChanged();
+        update();
+    }
+
+    void setColorRangeMax(double colorRangeMax) {
+        _colorRangeMax = colorRangeMax;
+        emit colorRangeChanged();
+        update();
     }
 
     void setRegionOfStudy(QObject* regionOfStudy) {
@@ -167,7 +293,22 @@ public:
     }
 
     Q_INVOKABLE QVariant doCalculate();
+    // runs the calculation on the global thread pool, the result is delivered
+    // with calculationFinished; returns false if a calculation is already running
+    // or the input is invalid
+    Q_INVOKABLE bool calculateAsync();
+    // the automatic solver selection picks SparseLDLT or SparseLU, which can't
+    // be interrupted: the calculation stops at the start of the next phase, a
+    // cancel during the factorization waits for it and calculationCancelled
+    // follows once it is done
+    Q_INVOKABLE void cancelCalculation();
+    // metrics of the last solve as a single line of JSON
+    Q_INVOKABLE QString metricsJson() const;
     Q_INVOKABLE void clear();
+    // longitudes and latitudes of the item edges on the map; the renderer maps
+    // them to the edges of the framebuffer, so moving or zooming the map only
+    // changes a uniform. Without them the solution bounds fill the item.
+    Q_INVOKABLE void setViewBounds(double west, double south, double east, double north);
 
 signals:
     void triMinAngleChanged();
@@ -184,15 +325,62 @@ signals:
     void sigmaChanged();
     void alphaChanged();
     void hasDataChanged();
+    void calculatingChanged();
+    void progressChanged();
+    void metricsChanged();
+    void colormapChanged();
+    void colorGammaChanged();
+    void colorRangeChanged();
+    void renderCountChanged();
+    void calculationFinished(QVariant minPoints);
+    void calculationFailed(QString error);
+    void calculationCancelled();
 
 private:
+    // copy of everything the calculation needs, QML objects
+    // can't be accessed from the worker thread
+    struct CalculationInput {
+        QVector<intcalc::Vector2d> regionOfStudy;
+        QVector<intcalc::Vector2d> gamma2;
+        QVector<QVector<intcalc::Vector2d>> conservacyAreas;
+        QVector<QVector<intcalc::Vector2d>> polutionSourceRegions;
+        bool calculateGamma2;
+        double triMinAngle;
+        double triMaxArea;
+        double windX;
+        double windY;
+        double mu;
+        double sigma;
+        double alpha;
+    };
+
+    // shared with the workers, owner is cleared when this is destroyed
+    struct WorkerLink {
+        QMutex mutex;
+        CalculationResultComponent* owner = nullptr;
+    };
+
+    struct CalculationOutput {
+        intcalc::CalcSolution solution;
+        QString error;
+        bool cancelled;
+    };
+
+    CalculationInput readCalculationInput();
+    static intcalc::CalcSolution runCalculation(CalculationInput& input,
+                                                const std::atomic<bool>* cancelled,
+                                                intcalc::FEMCalculator::ProgressCallback progressCallback);
+    void onCalculationFinished();
+    void setCalculating(bool calculating);
+    void setProgress(double progress, const QString& phase);
     void acceptFEMSolution(intcalc::CalcSolution& solution);
+    void startLodBuild();
+    void onLodFinished();
+    void recordMetrics(const intcalc::SolveMetrics& metrics);
 
-    QVector<QVector2D>* vertices;
-    QVector<QVector4D>* colors;
-    QVector<unsigned int>* indices;
-    bool* dataChanged;
-    bool* _showTriangulation;
+    std::shared_ptr<const intcalc::SolutionData> _solutionData;
+    QVector<intcalc::LodLevel> _lodLevels;
+    bool _showTriangulation;
 
     double _triMinAngle;
     double _triMaxArea;
@@ -207,6 +395,31 @@ private:
     double _sigma;
     double _alpha;
     bool _hasData;
+
+    QFutureWatcher<CalculationOutput>* _calculationWatcher;
+    std::shared_ptr<WorkerLink> _workerLink;
+    // shared with the worker, a new flag for every calculation
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+    bool _calculating;
+    double _progress;
+    QString _progressPhase;
+    intcalc::SolveMetrics _metrics;
+    QFutureWatcher<QVector<intcalc::LodLevel>>* _lodWatcher;
+    // solution the running build is simplifying
+    std::shared_ptr<const intcalc::SolutionData> _lodSource;
+    QString _colormap;
+    double _colorGamma;
+    double _colorRangeMin;
+    double _colorRangeMax;
+    bool _hasViewBounds;
+    double _viewWest;
+    double _viewSouth;
+    double _viewEast;
+    double _viewNorth;
+    // written by the renderer in synchronize, while this thread is blocked
+    int _renderCount;
+
+    friend class TriangleGradientRenderer;
 };
 
 #endif // CALCULATIONRESULTCOMPONENT_H
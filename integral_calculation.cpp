@@ -2,9 +2,17 @@
 
 #include <math.h>
 #include <algorithm>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <unordered_set>
+#include <QCryptographicHash>
 #include <QDebug>
 #include <QElapsedTimer>
 
+#include "integral_calculation_adaptive.h"
+#include "integral_calculation_cache.h"
+#include "integral_calculation_trace.h"
 #include "integral_calculation_utils.h"
 
 #ifdef INTCALC_DEBUG
@@ -15,7 +23,266 @@ using std::endl;
 #endif
 
 namespace intcalc {
-    FEMCalculator::FEMCalculator() {
+    FEMCalculator::FEMCalculator()
+        : _solverType(LinearSolver::Type::AUTO),
+          _assemblyThreads(0),
+          _minTrianglesPerThread(4096),
+          _usedAssemblyThreads(0),
+          _assemblyKernel(AssemblyKernel::FUSED),
+          _useMeshCache(true),
+          _computeAreaFields(false),
+          _cancelled(nullptr) {
+    }
+
+    QVariantMap SolveMetrics::toVariantMap() const {
+        return toJson().toVariantMap();
+    }
+
+    QJsonObject SolveMetrics::toJson() const {
+        QJsonObject object;
+        object.insert("triangulationTime", triangulationTime);
+        object.insert("classificationTime", classificationTime);
+        object.insert("assemblyTime", assemblyTime);
+        object.insert("solveTime", solveTime);
+        object.insert("extractionTime", extractionTime);
+        object.insert("totalTime", totalTime);
+        object.insert("meshFromCache", meshFromCache);
+        object.insert("vertices", vertices);
+        object.insert("triangles", triangles);
+        object.insert("unknowns", unknowns);
+        object.insert("nonZeros", static_cast<double>(nonZeros));
+        object.insert("solverName", solverName);
+        object.insert("iterations", iterations);
+        object.insert("processPeakMemory", static_cast<double>(processPeakMemory));
+        object.insert("refinements", refinements);
+        object.insert("estimatedError", estimatedError);
+        return object;
+    }
+
+    QVector<double> CalcSolution::weightedAreaField(const QVector<double>& weights) const {
+        if (weights.size() != areaFields.size()) {
+            throw "Amount of weights differs from the amount of area fields!";
+        }
+
+        QVector<double> field(data->verticesCount(), 0.0);
+        for (int area = 0; area < areaFields.size(); area++) {
+            for (int i = 0; i < field.size(); i++) {
+                field[i] += weights[area] * areaFields[area][i];
+            }
+        }
+        return field;
+    }
+
+    Mesh::Mesh(triangulateio& out)
+        : _x(out.numberofpoints),
+          _y(out.numberofpoints),
+          _triangles(out.trianglelist),
+          _trianglesCount(out.numberoftriangles),
+          _corners(out.numberofcorners),
+          _types(out.numberofpoints, VertexInfo::Type::NONE),
+          _flags(out.numberofpoints, 0),
+          _hasEdgeTable(out.edgelist != nullptr && out.edgemarkerlist != nullptr),
+          _gamma2Edges(out.numberoftriangles, 0),
+          _gamma2EdgesCount(0) {
+        for (int i = 0; i < out.numberofpoints; i++) {
+            _x[i] = out.pointlist[i * 2];
+            _y[i] = out.pointlist[i * 2 + 1];
+        }
+
+        if (out.pointmarkerlist != nullptr) {
+            for (int i = 0; i < out.numberofpoints; i++) {
+                switch (out.pointmarkerlist[i]) {
+                case BoundaryMarker::GAMMA_1_BOUNDARY:
+                    _types[i] = VertexInfo::Type::GAMMA_1;
+                    break;
+                case BoundaryMarker::GAMMA_2_BOUNDARY:
+                    _types[i] = VertexInfo::Type::GAMMA_2;
+                    break;
+                default:
+                    _types[i] = VertexInfo::Type::INNER;
+                }
+            }
+        }
+
+        if (out.triangleattributelist != nullptr && out.numberoftriangleattributes > 0) {
+            _triangleRegions.resize(out.numberoftriangles);
+            for (int i = 0; i < out.numberoftriangles; i++) {
+                _triangleRegions[i] = static_cast<int>(out.triangleattributelist[i * out.numberoftriangleattributes]);
+            }
+        }
+
+        if (_hasEdgeTable) {
+            auto edgeKey = [](int a, int b) {
+                return (static_cast<unsigned long long>(std::min(a, b)) << 32)
+                        | static_cast<unsigned int>(std::max(a, b));
+            };
+
+            std::unordered_set<unsigned long long> gamma2Edges;
+            for (int i = 0; i < out.numberofedges; i++) {
+                if (out.edgemarkerlist[i] == BoundaryMarker::GAMMA_2_BOUNDARY) {
+                    gamma2Edges.insert(edgeKey(out.edgelist[i * 2], out.edgelist[i * 2 + 1]));
+                }
+            }
+            _gamma2EdgesCount = static_cast<int>(gamma2Edges.size());
+
+            for (int i = 0; i < out.numberoftriangles && !gamma2Edges.empty(); i++) {
+                const int* corners = out.trianglelist + i * out.numberofcorners;
+                for (int k = 0; k < 3; k++) {
+                    if (gamma2Edges.count(edgeKey(corners[(k + 1) % 3], corners[(k + 2) % 3])) > 0) {
+                        _gamma2Edges[i] |= 1 << k;
+                    }
+                }
+            }
+        }
+
+        if (out.segmentlist != nullptr) {
+            _segments.assign(out.segmentlist, out.segmentlist + out.numberofsegments * 2);
+            _segmentMarkers.assign(out.numberofsegments, BoundaryMarker::NO_BOUNDARY);
+            if (out.segmentmarkerlist != nullptr) {
+                _segmentMarkers.assign(out.segmentmarkerlist, out.segmentmarkerlist + out.numberofsegments);
+            }
+        }
+
+        // the triangle list is adopted as it is, everything else is released here
+        out.trianglelist = nullptr;
+        intcalc_utils::freeTriangulation(out);
+
+        if (out.numberofcorners != 3 && out.numberofcorners != 6) {
+            free(_triangles);
+            throw "Only triangles with 3 or 6 corners are supported!";
+        }
+    }
+
+    Mesh::Mesh()
+        : _triangles(nullptr),
+          _trianglesCount(0),
+          _corners(3),
+          _hasEdgeTable(false),
+          _gamma2EdgesCount(0) {
+    }
+
+    Mesh::~Mesh() {
+        free(_triangles);
+    }
+
+    namespace {
+        template<typename T>
+        void writeVector(QDataStream& stream, const vector<T>& v) {
+            stream << static_cast<qint32>(v.size());
+            stream.writeRawData(reinterpret_cast<const char*>(v.data()), static_cast<int>(v.size() * sizeof(T)));
+        }
+
+        // sizes are read from the file, nothing is allocated for data
+        // that is not there
+        bool canRead(QDataStream& stream, qint64 bytes) {
+            return bytes <= std::numeric_limits<int>::max()
+                    && (stream.device() == nullptr || bytes <= stream.device()->bytesAvailable());
+        }
+
+        template<typename T>
+        bool readVector(QDataStream& stream, vector<T>& v) {
+            qint32 size = 0;
+            stream >> size;
+            if (size < 0 || stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            const qint64 bytes = static_cast<qint64>(size) * static_cast<qint64>(sizeof(T));
+            if (!canRead(stream, bytes)) {
+                return false;
+            }
+            v.resize(size);
+            return stream.readRawData(reinterpret_cast<char*>(v.data()), static_cast<int>(bytes)) == bytes;
+        }
+    }
+
+    QByteArray Mesh::fingerprint() const {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(reinterpret_cast<const char*>(&_corners), sizeof(_corners));
+        hash.addData(reinterpret_cast<const char*>(_x.data()), static_cast<int>(_x.size() * sizeof(double)));
+        hash.addData(reinterpret_cast<const char*>(_y.data()), static_cast<int>(_y.size() * sizeof(double)));
+        hash.addData(reinterpret_cast<const char*>(_triangles), _trianglesCount * _corners * static_cast<int>(sizeof(int)));
+        return hash.result();
+    }
+
+    void Mesh::write(QDataStream& stream) const {
+        writeVector(stream, _x);
+        writeVector(stream, _y);
+        stream << static_cast<qint32>(_trianglesCount) << static_cast<qint32>(_corners);
+        stream.writeRawData(reinterpret_cast<const char*>(_triangles), _trianglesCount * _corners * static_cast<int>(sizeof(int)));
+        writeVector(stream, _types);
+        writeVector(stream, _flags);
+        writeVector(stream, _triangleRegions);
+        stream << _hasEdgeTable;
+        writeVector(stream, _gamma2Edges);
+        stream << static_cast<qint32>(_gamma2EdgesCount);
+        writeVector(stream, _segments);
+        writeVector(stream, _segmentMarkers);
+    }
+
+    Mesh* Mesh::read(QDataStream& stream) {
+        std::unique_ptr<Mesh> mesh(new Mesh());
+        if (!readVector(stream, mesh->_x) || !readVector(stream, mesh->_y)) {
+            return nullptr;
+        }
+
+        qint32 trianglesCount = 0;
+        qint32 corners = 0;
+        stream >> trianglesCount >> corners;
+        if (trianglesCount < 0 || (corners != 3 && corners != 6) || stream.status() != QDataStream::Ok) {
+            return nullptr;
+        }
+        const qint64 bytes = static_cast<qint64>(trianglesCount) * corners * static_cast<qint64>(sizeof(int));
+        if (!canRead(stream, bytes)) {
+            return nullptr;
+        }
+        mesh->_trianglesCount = trianglesCount;
+        mesh->_corners = corners;
+        mesh->_triangles = static_cast<int*>(malloc(bytes > 0 ? static_cast<size_t>(bytes) : 1));
+        if (mesh->_triangles == nullptr
+                || stream.readRawData(reinterpret_cast<char*>(mesh->_triangles), static_cast<int>(bytes)) != bytes) {
+            return nullptr;
+        }
+
+        qint32 gamma2EdgesCount = 0;
+        if (!readVector(stream, mesh->_types)
+                || !readVector(stream, mesh->_flags)
+                || !readVector(stream, mesh->_triangleRegions)) {
+            return nullptr;
+        }
+        stream >> mesh->_hasEdgeTable;
+        if (!readVector(stream, mesh->_gamma2Edges)) {
+            return nullptr;
+        }
+        stream >> gamma2EdgesCount;
+        mesh->_gamma2EdgesCount = gamma2EdgesCount;
+        if (!readVector(stream, mesh->_segments) || !readVector(stream, mesh->_segmentMarkers)) {
+            return nullptr;
+        }
+
+        // reject truncated or inconsistent data instead of indexing out of bounds later
+        const int vertices = mesh->verticesCount();
+        bool valid = stream.status() == QDataStream::Ok
+                && mesh->_y.size() == mesh->_x.size()
+                && static_cast<int>(mesh->_types.size()) == vertices
+                && static_cast<int>(mesh->_flags.size()) == vertices
+                && (mesh->_triangleRegions.empty() || static_cast<int>(mesh->_triangleRegions.size()) == trianglesCount)
+                && static_cast<int>(mesh->_gamma2Edges.size()) == trianglesCount
+                && mesh->_segments.size() == mesh->_segmentMarkers.size() * 2;
+        for (qint64 i = 0; valid && i < static_cast<qint64>(trianglesCount) * corners; i++) {
+            valid = mesh->_triangles[i] >= 0 && mesh->_triangles[i] < vertices;
+        }
+        for (size_t i = 0; valid && i < mesh->_segments.size(); i++) {
+            valid = mesh->_segments[i] >= 0 && mesh->_segments[i] < vertices;
+        }
+        return valid ? mesh.release() : nullptr;
+    }
+
+    VertexInfo Mesh::vertex(int index) const {
+        VertexInfo vertex(_x[index], _y[index]);
+        vertex.setType(type(index));
+        vertex.setIsInConservacyArea(hasFlag(index, IN_CONSERVACY_AREA));
+        vertex.setIsInPolutionSourceRegion(hasFlag(index, IN_POLUTION_SOURCE_REGION));
+        return vertex;
     }
 
     double jacobian(const DiscreteElement& el) {
@@ -87,16 +354,20 @@ namespace intcalc {
         return _alpha - _beta * n(edgeCenter);
     }
 
+    double FEMCalculator::boundaryIntegral(int i, int j, const DiscreteElement& el, vector<int>& edges) {
+        double result = 0.0;
+        for (unsigned int k = 0; k < edges.size(); k++) {
+            result += b(el.eCenter(edges[k])) * fourthIntegral(i, j, edges[k], el.eLen(edges[k]));
+        }
+        return result;
+    }
+
     double FEMCalculator::m_ij(int i, int j, const DiscreteElement& el, vector<int>& edges) {
         double result = _mu * firstIntegral(i, j, el)
                 - _beta * secondIntegral(j, el)
                 + _sigma * thirdIntegral(i, j, el);
 
-        for (unsigned int k = 0; k < edges.size(); k++) {
-            result += b(el.eCenter(edges[k])) * fourthIntegral(i, j, edges[k], el.eLen(edges[k]));
-        }
-
-        return result;
+        return result + boundaryIntegral(i, j, el, edges);
     }
 
     // TODO: rename this method
@@ -128,9 +399,27 @@ namespace intcalc {
         return edges;
     }
 
-    void FEMCalculator::m(double** g, const DiscreteElement& el, const int* triangle) {
-        vector<int> edges = findOutBoundaryEdges(el, _gamma2);
+    vector<int> FEMCalculator::boundaryEdges(const Mesh& mesh, int index, const DiscreteElement& el) const {
+        if (!mesh.hasEdgeTable()) {
+            return findOutBoundaryEdges(el, _gamma2);
+        }
 
+        vector<int> edges;
+        const uint8_t mask = mesh.gamma2Edges(index);
+        if (mask == 0) {
+            return edges;
+        }
+        // same order as findOutBoundaryEdges
+        const int order[3] = { 2, 0, 1 };
+        for (int k : order) {
+            if ((mask & (1 << k)) != 0) {
+                edges.push_back(k);
+            }
+        }
+        return edges;
+    }
+
+    void FEMCalculator::m(vector<Triplet>& triplets, const DiscreteElement& el, const int* triangle, vector<int>& edges) {
         for (int i = 0; i < 3; i++) {
             if (el.v[i]->type() == VertexInfo::Type::GAMMA_1) {
                 continue;
@@ -139,113 +428,841 @@ namespace intcalc {
                 if (el.v[j]->type() == VertexInfo::Type::GAMMA_1) {
                     continue;
                 }
-                g[triangle[i]][triangle[j]] += m_ij(i, j, el, edges);
+                triplets.push_back(Triplet(triangle[i], triangle[j], m_ij(i, j, el, edges)));
+            }
+        }
+    }
+
+    uint8_t FEMCalculator::gamma2EdgeMask(const Mesh& mesh, int index) const {
+        if (mesh.hasEdgeTable()) {
+            return mesh.gamma2Edges(index);
+        }
+
+        const int* triangle = mesh.triangle(index);
+        const VertexInfo v[3] = { mesh.vertex(triangle[0]), mesh.vertex(triangle[1]), mesh.vertex(triangle[2]) };
+        DiscreteElement el;
+        el.v[0] = &v[0];
+        el.v[1] = &v[1];
+        el.v[2] = &v[2];
+        uint8_t mask = 0;
+        for (int edge : findOutBoundaryEdges(el, _gamma2)) {
+            mask |= 1 << edge;
+        }
+        return mask;
+    }
+
+    // reads the corners from the batch and the vertex types from the mesh,
+    // the same terms as m_ij and boundaryIntegral
+    void FEMCalculator::mFused(vector<Triplet>& triplets,
+                               const ElementBatch& batch,
+                               int e,
+                               const Mesh& mesh,
+                               int index) {
+        const int* triangle = mesh.triangle(index);
+
+        double boundary[3][3] = { { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 0.0, 0.0 } };
+        const uint8_t mask = gamma2EdgeMask(mesh, index);
+        if (mask != 0) {
+            // same order as findOutBoundaryEdges
+            const int order[3] = { 2, 0, 1 };
+            for (int edge : order) {
+                if ((mask & (1 << edge)) == 0) {
+                    continue;
+                }
+                const int a = (edge + 1) % 3;
+                const int c = (edge + 2) % 3;
+                const Vector2d edgeCenter((batch.x[a][e] + batch.x[c][e]) / 2.0, (batch.y[a][e] + batch.y[c][e]) / 2.0);
+                const double length = sqrt(pow(batch.x[a][e] - batch.x[c][e], 2) + pow(batch.y[a][e] - batch.y[c][e], 2));
+                const double coefficient = b(edgeCenter);
+                for (int i = 0; i < 3; i++) {
+                    for (int j = 0; j < 3; j++) {
+                        boundary[i][j] += coefficient * fourthIntegral(i, j, edge, length);
+                    }
+                }
+            }
+        }
+
+        for (int i = 0; i < 3; i++) {
+            if (mesh.type(triangle[i]) == VertexInfo::Type::GAMMA_1) {
+                continue;
+            }
+            for (int j = 0; j < 3; j++) {
+                if (mesh.type(triangle[j]) == VertexInfo::Type::GAMMA_1) {
+                    continue;
+                }
+                triplets.push_back(Triplet(triangle[i], triangle[j], batch.m[i * 3 + j][e] + boundary[i][j]));
             }
         }
     }
 
-    double** FEMCalculator::M(QVector<VertexInfo>* vertices, QVector<int*> triangles) {
-        int gSize = vertices->size();
-        double** g = new double*[gSize];
-        for (int i = 0; i < gSize; i++) {
-            g[i] = new double[gSize];
-            for (int j = 0; j < gSize; j++) {
-                g[i][j] = 0.0;
+    void FEMCalculator::assembleFused(vector<Triplet>& triplets, const Mesh& mesh, int begin, int end) {
+        ElementCoefficients coefficients;
+        coefficients.mu = _mu;
+        coefficients.sigma = _sigma;
+        coefficients.betaX = _beta.x;
+        coefficients.betaY = _beta.y;
+
+        ElementBatch batch;
+        for (int first = begin; first < end; first += ElementBatch::SIZE) {
+            const int count = std::min(ElementBatch::SIZE, end - first);
+            for (int e = 0; e < ElementBatch::SIZE; e++) {
+                // pad the last batch with the reference triangle
+                if (e >= count) {
+                    batch.x[0][e] = 0.0;
+                    batch.y[0][e] = 0.0;
+                    batch.x[1][e] = 1.0;
+                    batch.y[1][e] = 0.0;
+                    batch.x[2][e] = 0.0;
+                    batch.y[2][e] = 1.0;
+                    continue;
+                }
+                const int* triangle = mesh.triangle(first + e);
+                for (int k = 0; k < 3; k++) {
+                    batch.x[k][e] = mesh.x(triangle[k]);
+                    batch.y[k][e] = mesh.y(triangle[k]);
+                }
+            }
+
+            computeElementMatrices(batch, coefficients);
+
+            for (int e = 0; e < count; e++) {
+                mFused(triplets, batch, e, mesh, first + e);
+            }
+        }
+    }
+
+    int FEMCalculator::assemblyThreadsCount(int trianglesCount) const {
+        int threads = _assemblyThreads;
+        if (threads <= 0) {
+            threads = static_cast<int>(std::thread::hardware_concurrency());
+        }
+        threads = std::min(threads, trianglesCount / _minTrianglesPerThread);
+        return std::max(threads, 1);
+    }
+
+    void FEMCalculator::assembleInParallel(int trianglesCount,
+                                           std::function<void(int part, int begin, int end)> assembleRange) {
+        const int threadsCount = assemblyThreadsCount(trianglesCount);
+        _usedAssemblyThreads = threadsCount;
+        // anything a worker throws, e.g. bad_alloc for the triplets of a
+        // large mesh, is rethrown here instead of terminating
+        vector<std::exception_ptr> errors(threadsCount);
+
+        auto runPart = [&](int part) {
+            const int begin = static_cast<int>(static_cast<long long>(trianglesCount) * part / threadsCount);
+            const int end = static_cast<int>(static_cast<long long>(trianglesCount) * (part + 1) / threadsCount);
+            try {
+                INTCALC_TRACE_SCOPE("assemble range");
+                assembleRange(part, begin, end);
+            } catch (...) {
+                errors[part] = std::current_exception();
+            }
+        };
+
+        vector<std::thread> workers;
+        for (int part = 1; part < threadsCount; part++) {
+            workers.push_back(std::thread(runPart, part));
+        }
+        runPart(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        for (auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
             }
         }
+    }
 
-        for (int i = 0; i < triangles.size(); i++) {
-            const int* triangle = triangles[i];
-            DiscreteElement el;
-            el.v[0] = &vertices->at(triangle[0]);
-            el.v[1] = &vertices->at(triangle[1]);
-            el.v[2] = &vertices->at(triangle[2]);
-            m(g, el, triangle);
+    SparseMatrix FEMCalculator::M(const Mesh& mesh) {
+        INTCALC_TRACE_SCOPE("M");
+        // the fused and the reference kernels are closed forms of the linear
+        // element, other elements go through the split operators
+        if (ActiveElement::NODES != LinearElement::NODES) {
+            SplitOperators operators;
+            assembleSplitOperators(mesh, operators);
+            return operators.combine(ParameterSet(_mu, _sigma, _alpha, _beta.x, _beta.y));
         }
 
+        // each thread assembles a contiguous range of triangles into its own
+        // triplet buffer, the buffers are concatenated in range order so the
+        // summation order in setFromTriplets is the same as on a single thread
+        const int trianglesCount = mesh.trianglesCount();
+        const int threadsCount = assemblyThreadsCount(trianglesCount);
+        vector<vector<Triplet>> partialTriplets(threadsCount);
+
+        assembleInParallel(trianglesCount, [&](int part, int begin, int end) {
+            vector<Triplet>& triplets = partialTriplets[part];
+            // every element contributes at most a 3x3 block
+            triplets.reserve((end - begin) * 9);
+            if (_assemblyKernel == AssemblyKernel::FUSED) {
+                assembleFused(triplets, mesh, begin, end);
+                return;
+            }
+            for (int i = begin; i < end; i++) {
+                const int* triangle = mesh.triangle(i);
+                const VertexInfo v[3] = { mesh.vertex(triangle[0]), mesh.vertex(triangle[1]), mesh.vertex(triangle[2]) };
+                DiscreteElement el;
+                el.v[0] = &v[0];
+                el.v[1] = &v[1];
+                el.v[2] = &v[2];
+                vector<int> edges = boundaryEdges(mesh, i, el);
+                m(triplets, el, triangle, edges);
+            }
+        });
+
+        vector<Triplet> triplets;
+        if (threadsCount == 1) {
+            triplets.swap(partialTriplets[0]);
+        } else {
+            size_t tripletsCount = 0;
+            for (auto& partial : partialTriplets) {
+                tripletsCount += partial.size();
+            }
+            triplets.reserve(tripletsCount);
+            for (auto& partial : partialTriplets) {
+                triplets.insert(triplets.end(), partial.begin(), partial.end());
+                vector<Triplet>().swap(partial);
+            }
+        }
+
+        SparseMatrix g(mesh.verticesCount(), mesh.verticesCount());
+        g.setFromTriplets(triplets.begin(), triplets.end());
         return g;
     }
 
-    QVector<VertexInfo>* FEMCalculator::prepareDiscreteVerticies(triangulateio& out) {
-        QVector<VertexInfo>* vertices = new QVector<VertexInfo>();
-        for (int i = 0; i < out.numberofpoints; i++) {
-            double x = out.pointlist[i * 2];
-            double y = out.pointlist[i * 2 + 1];
-            VertexInfo vertex(x, y);
-
-            if (!_regionOfStudy.hasVertexOnContour(vertex)) {
-                vertex.setType(VertexInfo::Type::INNER);
-            } else if (_gamma2.hasVertexOnContour(vertex)) {
-                vertex.setType(VertexInfo::Type::GAMMA_2);
-            } else {
-                vertex.setType(VertexInfo::Type::GAMMA_1);
-            }
-
-            vertex.setIsInConservacyArea(false);
-            for (auto area : _conservacyAreas) {
-                if (area.hasVertexInside(vertex)) {
-                    vertex.setIsInConservacyArea(true);
+    namespace {
+        // one entry of the element matrices of all split operators
+        struct OperatorEntry {
+            int row;
+            int col;
+            double values[SplitOperators::PARTS_COUNT];
+        };
+    }
+
+    SparseMatrix SplitOperators::combine(const ParameterSet& p) const {
+        const double coefficients[PARTS_COUNT] = {
+            p.mu, -p.betaX, -p.betaY, p.sigma, p.alpha, -p.betaX, -p.betaY
+        };
+
+        SparseMatrix g = parts[K];
+        double* values = g.valuePtr();
+        const int nonZeros = static_cast<int>(g.nonZeros());
+        for (int part = 0; part < PARTS_COUNT; part++) {
+            if (parts[part].nonZeros() != nonZeros) {
+                throw "Split operators have different sparsity patterns!";
+            }
+        }
+        for (int k = 0; k < nonZeros; k++) {
+            double value = 0.0;
+            for (int part = 0; part < PARTS_COUNT; part++) {
+                value += coefficients[part] * parts[part].valuePtr()[k];
+            }
+            values[k] = value;
+        }
+        return g;
+    }
+
+    namespace {
+        // entries of all split operator parts for the nodes of one triangle,
+        // the same terms as m_ij and boundaryIntegral; gamma 1 nodes are left out
+        template<typename Element>
+        void elementEntries(vector<OperatorEntry>& entries,
+                            const Mesh& mesh,
+                            int index,
+                            const DiscreteElement& el,
+                            const vector<int>& edges) {
+            const int* nodes = mesh.triangle(index);
+            const double x[3] = { el.v[0]->x, el.v[1]->x, el.v[2]->x };
+            const double y[3] = { el.v[0]->y, el.v[1]->y, el.v[2]->y };
+            ElementMatrices<Element> matrices;
+            Element::integrate(x, y, matrices);
+
+            double edgeMatrices[3][Element::NODES][Element::NODES];
+            Vector2d normals[3];
+            for (int edge : edges) {
+                Element::integrateEdge(edge, el.eLen(edge), edgeMatrices[edge]);
+                Vector2d edgeCenter = el.eCenter(edge);
+                normals[edge] = n(edgeCenter);
+            }
+
+            for (int i = 0; i < Element::NODES; i++) {
+                if (mesh.type(nodes[i]) == VertexInfo::Type::GAMMA_1) {
+                    continue;
+                }
+                for (int j = 0; j < Element::NODES; j++) {
+                    if (mesh.type(nodes[j]) == VertexInfo::Type::GAMMA_1) {
+                        continue;
+                    }
+                    OperatorEntry entry;
+                    entry.row = nodes[i];
+                    entry.col = nodes[j];
+                    entry.values[SplitOperators::K] = matrices.stiffness[i][j];
+                    entry.values[SplitOperators::CX] = matrices.convectionX[i][j];
+                    entry.values[SplitOperators::CY] = matrices.convectionY[i][j];
+                    entry.values[SplitOperators::MASS] = matrices.mass[i][j];
+                    entry.values[SplitOperators::E] = 0.0;
+                    entry.values[SplitOperators::EX] = 0.0;
+                    entry.values[SplitOperators::EY] = 0.0;
+                    // b(edgeCenter) split into alpha and the beta components
+                    for (int edge : edges) {
+                        const double integral = edgeMatrices[edge][i][j];
+                        entry.values[SplitOperators::E] += integral;
+                        entry.values[SplitOperators::EX] += normals[edge].x * integral;
+                        entry.values[SplitOperators::EY] += normals[edge].y * integral;
+                    }
+                    entries.push_back(entry);
+                }
+            }
+        }
+    }
+
+    const SplitOperators& FEMCalculator::splitOperators(std::shared_ptr<const Mesh> meshHandle) {
+        if (_operatorsMesh == meshHandle) {
+            return _operators;
+        }
+        INTCALC_TRACE_SCOPE("splitOperators");
+        assembleSplitOperators(*meshHandle, _operators);
+        _operatorsMesh = meshHandle;
+        return _operators;
+    }
+
+    // every part gets an entry for each non gamma 1 pair of the element,
+    // including zeros, so the patterns of all parts are identical
+    void FEMCalculator::assembleSplitOperators(const Mesh& mesh, SplitOperators& operators) {
+        const int trianglesCount = mesh.trianglesCount();
+        vector<vector<OperatorEntry>> partialEntries(assemblyThreadsCount(trianglesCount));
+
+        assembleInParallel(trianglesCount, [&](int part, int begin, int end) {
+            vector<OperatorEntry>& entries = partialEntries[part];
+            entries.reserve((end - begin) * ActiveElement::NODES * ActiveElement::NODES);
+            for (int index = begin; index < end; index++) {
+                const int* triangle = mesh.triangle(index);
+                const VertexInfo v[3] = { mesh.vertex(triangle[0]), mesh.vertex(triangle[1]), mesh.vertex(triangle[2]) };
+                DiscreteElement el;
+                el.v[0] = &v[0];
+                el.v[1] = &v[1];
+                el.v[2] = &v[2];
+                elementEntries<ActiveElement>(entries, mesh, index, el, boundaryEdges(mesh, index, el));
+            }
+        });
+
+        size_t entriesCount = 0;
+        for (auto& partial : partialEntries) {
+            entriesCount += partial.size();
+        }
+        vector<Triplet> triplets;
+        triplets.reserve(entriesCount);
+        for (int part = 0; part < SplitOperators::PARTS_COUNT; part++) {
+            triplets.clear();
+            for (auto& partial : partialEntries) {
+                for (auto& entry : partial) {
+                    triplets.push_back(Triplet(entry.row, entry.col, entry.values[part]));
                 }
             }
+            operators.parts[part] = SparseMatrix(mesh.verticesCount(), mesh.verticesCount());
+            operators.parts[part].setFromTriplets(triplets.begin(), triplets.end());
+        }
+    }
+
+    namespace {
+        // ms since the last lap, restarts the timer
+        double lap(QElapsedTimer& timer) {
+            const double ms = timer.nsecsElapsed() / 1000000.0;
+            timer.restart();
+            return ms;
+        }
+
+        // bump when the triangulation or the vertex classification changes,
+        // so meshes stored on disk by older versions are not reused
+        const int MESH_KEY_VERSION = 2;
+
+        void addRegionToHash(QCryptographicHash& hash, const Region& region) {
+            const int size = region.points() != nullptr ? region.points()->size() : -1;
+            hash.addData(reinterpret_cast<const char*>(&size), sizeof(size));
+            for (int i = 0; i < size; i++) {
+                const double xy[2] = { region.points()->at(i).x, region.points()->at(i).y };
+                hash.addData(reinterpret_cast<const char*>(xy), sizeof(xy));
+            }
+        }
+
+        void addRegionsToHash(QCryptographicHash& hash, const QVector<Region>& regions) {
+            const int count = regions.size();
+            hash.addData(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const Region& region : regions) {
+                addRegionToHash(hash, region);
+            }
+        }
+    }
+
+    // everything the triangulation and the vertex classification depend on,
+    // mu, sigma, alpha and beta only affect the global matrix
+    QByteArray FEMCalculator::meshKey() const {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(reinterpret_cast<const char*>(&MESH_KEY_VERSION), sizeof(MESH_KEY_VERSION));
+        hash.addData(_triangulationSwitches.toUtf8());
+        addRegionToHash(hash, _regionOfStudy);
+        addRegionToHash(hash, _gamma2);
+        addRegionsToHash(hash, _conservacyAreas);
+        addRegionsToHash(hash, _polutionSourceRegions);
+        return hash.result();
+    }
 
-            vertex.setIsInPolutionSourceRegion(false);
-            for (auto region : _polutionSourceRegions) {
-                if (region.hasVertexInside(vertex)) {
-                    vertex.setIsInPolutionSourceRegion(true);
+    std::shared_ptr<const Mesh> FEMCalculator::prepareMesh(QElapsedTimer& timer, SolveMetrics& metrics) {
+        INTCALC_TRACE_SCOPE("prepareMesh");
+        QByteArray key;
+        if (_useMeshCache) {
+            key = meshKey();
+            MeshCache& cache = MeshCache::instance();
+            std::shared_ptr<const Mesh> cached = cache.find(key);
+            if (cached) {
+                metrics.meshFromCache = true;
+                qInfo() << "Reused cached mesh (" << lap(timer) << "ms )";
+                qInfo() << "--- numberofverticies: " << cached->verticesCount();
+                qInfo() << "--- numberoftriangles: " << cached->trianglesCount();
+                qInfo() << "--- cache hits: " << cache.hits() << ", misses: " << cache.misses()
+                        << ", from disk: " << cache.diskHits();
+                return cached;
+            }
+        }
+
+        const QVector<Region> areas = meshAreas();
+        triangulateio out = intcalc_utils::doTriangulate(_triangulationSwitches,
+                                                         _regionOfStudy,
+                                                         _gamma2,
+                                                         areas,
+                                                         conformingAreas(areas));
+        metrics.triangulationTime = lap(timer);
+        qInfo() << "Finish triangulation (" << metrics.triangulationTime << "ms )";
+        qInfo() << "--- numberofverticies: " << out.numberofpoints;
+        qInfo() << "--- numberoftriangles: " << out.numberoftriangles;
+
+        std::shared_ptr<Mesh> mesh;
+        {
+            INTCALC_TRACE_SCOPE("Mesh");
+            mesh = std::make_shared<Mesh>(out);
+        }
+        prepareDiscreteVerticies(*mesh);
+        metrics.classificationTime = lap(timer);
+        qInfo() << "Prepared verticies (" << metrics.classificationTime << "ms )";
+        if (mesh->hasEdgeTable()) {
+            qInfo() << "--- gamma 2 edges: " << mesh->gamma2EdgesCount();
+        }
+
+        if (_useMeshCache) {
+            MeshCache::instance().insert(key, mesh);
+        }
+        return mesh;
+    }
+
+    // conservacy areas followed by polution source regions,
+    // the regional attribute of a triangle is the index in this list + 1
+    QVector<Region> FEMCalculator::meshAreas() const {
+        QVector<Region> areas;
+        for (const Region& area : _conservacyAreas) {
+            areas.push_back(area);
+        }
+        for (const Region& region : _polutionSourceRegions) {
+            areas.push_back(region);
+        }
+        return areas;
+    }
+
+    // a triangle carries only one regional attribute, so areas that may overlap
+    // with another one or are not inside of the region of study are
+    // classified geometrically instead
+    vector<bool> FEMCalculator::conformingAreas(const QVector<Region>& areas) const {
+        vector<bool> conforming(areas.size(), true);
+        for (int i = 0; i < areas.size(); i++) {
+            Vector2d seed;
+            if (!intcalc_utils::findInteriorPoint(areas[i], seed)
+                    || !_regionOfStudy.hasVertexInside(seed)
+                    || !intcalc_utils::isInsideRegion(areas[i], _regionOfStudy)) {
+                conforming[i] = false;
+            }
+            for (int j = i + 1; j < areas.size(); j++) {
+                if (areas[i].boundsIntersect(areas[j])) {
+                    conforming[i] = false;
+                    conforming[j] = false;
                 }
             }
+        }
+        return conforming;
+    }
 
-            vertices->push_back(vertex);
+    void FEMCalculator::prepareDiscreteVerticies(Mesh& mesh) {
+        INTCALC_TRACE_SCOPE("prepareDiscreteVerticies");
+        const QVector<Region> areas = meshAreas();
+        const vector<bool> conforming = conformingAreas(areas);
+        auto areaFlag = [this](int area) {
+            return area < _conservacyAreas.size()
+                    ? Mesh::VertexFlag::IN_CONSERVACY_AREA
+                    : Mesh::VertexFlag::IN_POLUTION_SOURCE_REGION;
+        };
+
+        // area boundaries are mesh edges, so a vertex is inside an area
+        // if it belongs to a triangle of that area
+        for (int i = 0; i < mesh.trianglesCount(); i++) {
+            const int area = mesh.triangleRegion(i) - 1;
+            if (area < 0 || area >= areas.size() || !conforming[area]) {
+                continue;
+            }
+            const int* triangle = mesh.triangle(i);
+            for (int k = 0; k < mesh.cornersCount(); k++) {
+                mesh.setFlag(triangle[k], areaFlag(area));
+            }
+        }
+
+        for (int i = 0; i < mesh.verticesCount(); i++) {
+            Vector2d vertex(mesh.x(i), mesh.y(i));
+
+            // without boundary markers fall back to the geometric test
+            if (mesh.type(i) == VertexInfo::Type::NONE) {
+                if (!_regionOfStudy.hasVertexOnContour(vertex)) {
+                    mesh.setType(i, VertexInfo::Type::INNER);
+                } else if (_gamma2.hasVertexOnContour(vertex)) {
+                    mesh.setType(i, VertexInfo::Type::GAMMA_2);
+                } else {
+                    mesh.setType(i, VertexInfo::Type::GAMMA_1);
+                }
+            }
+
+            for (int area = 0; area < areas.size(); area++) {
+                if (!conforming[area] && areas[area].hasVertexInside(vertex)) {
+                    mesh.setFlag(i, areaFlag(area));
+                }
+            }
         }
-        return vertices;
     }
 
-    QVector<int*> prepareTrianglesVector(const triangulateio& out) {
-        QVector<int*> triangles;
-        for (int i = 0; i < out.numberoftriangles * out.numberofcorners; i += out.numberofcorners) {
-            triangles.push_back(new int[out.numberofcorners] {
-                out.trianglelist[i],
-                out.trianglelist[i + 1],
-                out.trianglelist[i + 2]
-            });
+    namespace {
+        // consistent load of the indicator in the nodes, the integral of f * phi_i
+        // over the elements; the indicator itself grows with the refinement of
+        // the mesh, and the corner functions of a quadratic triangle integrate to 0
+        template<typename Element>
+        Eigen::MatrixXd elementLoad(const Mesh& mesh, const Eigen::MatrixXd& f) {
+            Eigen::MatrixXd load = Eigen::MatrixXd::Zero(f.rows(), f.cols());
+            ElementMatrices<Element> matrices;
+            for (int i = 0; i < mesh.trianglesCount(); i++) {
+                const int* triangle = mesh.triangle(i);
+                double x[3];
+                double y[3];
+                for (int k = 0; k < 3; k++) {
+                    x[k] = mesh.x(triangle[k]);
+                    y[k] = mesh.y(triangle[k]);
+                }
+                Element::integrate(x, y, matrices);
+                for (int row = 0; row < Element::NODES; row++) {
+                    for (int col = 0; col < Element::NODES; col++) {
+                        load.row(triangle[row]) += matrices.mass[row][col] * f.row(triangle[col]);
+                    }
+                }
+            }
+            return load;
+        }
+    }
+
+    Eigen::MatrixXd FEMCalculator::rightHandSides(const Mesh& mesh) const {
+        INTCALC_TRACE_SCOPE("rightHandSides");
+        const int areasCount = _computeAreaFields ? _conservacyAreas.size() : 0;
+        Eigen::MatrixXd f = Eigen::MatrixXd::Zero(mesh.verticesCount(), 1 + areasCount);
+        for (int i = 0; i < mesh.verticesCount(); i++) {
+            if (mesh.hasFlag(i, Mesh::VertexFlag::IN_CONSERVACY_AREA)) {
+                f(i, 0) = 1;
+            }
+        }
+        if (areasCount == 0) {
+            return elementLoad<ActiveElement>(mesh, f);
+        }
+
+        // same classification as prepareDiscreteVerticies, but per area
+        const vector<bool> conforming = conformingAreas(meshAreas());
+        for (int i = 0; i < mesh.trianglesCount(); i++) {
+            const int area = mesh.triangleRegion(i) - 1;
+            if (area < 0 || area >= areasCount || !conforming[area]) {
+                continue;
+            }
+            const int* triangle = mesh.triangle(i);
+            for (int k = 0; k < mesh.cornersCount(); k++) {
+                f(triangle[k], 1 + area) = 1;
+            }
+        }
+        for (int area = 0; area < areasCount; area++) {
+            if (conforming[area]) {
+                continue;
+            }
+            for (int i = 0; i < mesh.verticesCount(); i++) {
+                if (_conservacyAreas[area].hasVertexInside(Vector2d(mesh.x(i), mesh.y(i)))) {
+                    f(i, 1 + area) = 1;
+                }
+            }
         }
-        return triangles;
+        return elementLoad<ActiveElement>(mesh, f);
     }
 
-    Eigen::MatrixXd solveMatrix(double** g, QVector<VertexInfo>* vertices, std::function<double(const VertexInfo&)> f) {
-        vector<int> nonGamma1;
-        for (int i = 0; i < vertices->size(); i++) {
-            if (vertices->at(i).type() == VertexInfo::Type::GAMMA_1) {
+    Eigen::MatrixXd FEMCalculator::solveMatrix(const SparseMatrix& g,
+                                               const Mesh& mesh,
+                                               const Eigen::MatrixXd& f,
+                                               SolverReport& report) {
+        INTCALC_TRACE_SCOPE("solveMatrix");
+        // maps global vertex index to the row of the reduced system,
+        // gamma 1 verticies are excluded and stay -1
+        vector<int> localIndex(mesh.verticesCount(), -1);
+        int nonGamma1 = 0;
+        for (int i = 0; i < mesh.verticesCount(); i++) {
+            if (mesh.type(i) == VertexInfo::Type::GAMMA_1) {
                 continue;
             }
-            nonGamma1.push_back(i);
+            localIndex[i] = nonGamma1;
+            nonGamma1++;
         }
 
-        if (nonGamma1.size() <= 0) {
-            qCritical() << "Non gamma: " << nonGamma1.size();
+        if (nonGamma1 <= 0) {
+            qCritical() << "Non gamma: " << nonGamma1;
             throw "Triangulation to small, no inner vertices found!";
         }
 
-        Eigen::MatrixXd a(nonGamma1.size(), nonGamma1.size());
-        Eigen::MatrixXd b(nonGamma1.size(), 1);
-        int localI = 0;
-        int localJ = 0;
-        for (auto i : nonGamma1) {
-            localJ = 0;
-            for (auto j : nonGamma1) {
-                a(localI, localJ) = g[i][j];
-                localJ++;
+        vector<Triplet> triplets;
+        triplets.reserve(g.nonZeros());
+        for (int col = 0; col < g.outerSize(); col++) {
+            if (localIndex[col] < 0) {
+                continue;
+            }
+            for (SparseMatrix::InnerIterator it(g, col); it; ++it) {
+                if (localIndex[it.row()] < 0) {
+                    continue;
+                }
+                triplets.push_back(Triplet(localIndex[it.row()], localIndex[col], it.value()));
+            }
+        }
+
+        SparseMatrix a(nonGamma1, nonGamma1);
+        a.setFromTriplets(triplets.begin(), triplets.end());
+
+        Eigen::MatrixXd b(nonGamma1, f.cols());
+        for (int i = 0; i < mesh.verticesCount(); i++) {
+            if (localIndex[i] >= 0) {
+                b.row(localIndex[i]) = f.row(i);
             }
-            b(localI, 0) = f(vertices->at(i));
-            localI++;
         }
 
-        return a.fullPivLu().solve(b);
+        QElapsedTimer timer;
+        timer.start();
+        IterativeSolverOptions options = _iterativeSolverOptions;
+        options.cancelled = _cancelled;
+        std::unique_ptr<LinearSolver> solver(createLinearSolver(_solverType, a, options));
+        report.selectionTime = timer.nsecsElapsed() / 1000000.0;
+        timer.restart();
+        {
+            INTCALC_TRACE_SCOPE("factorize");
+            if (!solver->factorize(a)) {
+                if (_solverType != LinearSolver::Type::AUTO || dynamic_cast<SparseLUSolver*>(solver.get()) != nullptr) {
+                    throw "Failed to factorize global matrix M!";
+                }
+                qWarning() << solver->name() << " factorization failed, falling back to SparseLU";
+                report.selectionTime += timer.nsecsElapsed() / 1000000.0;
+                timer.restart();
+                solver.reset(new SparseLUSolver());
+                if (!solver->factorize(a)) {
+                    throw "Failed to factorize global matrix M!";
+                }
+            }
+        }
+        report.solverName = solver->name();
+        report.factorizationTime = timer.nsecsElapsed() / 1000000.0;
+
+        timer.restart();
+        INTCALC_TRACE_SCOPE("solve");
+        Eigen::MatrixXd solution;
+        if (_solverType == LinearSolver::Type::BICGSTAB
+                && _initialGuess.size() == mesh.verticesCount()
+                && b.cols() == 1
+                && !_initialGuessMesh.isEmpty()
+                && _initialGuessMesh == mesh.fingerprint()) {
+            Eigen::VectorXd guess(nonGamma1);
+            for (int i = 0; i < mesh.verticesCount(); i++) {
+                if (localIndex[i] >= 0) {
+                    guess(localIndex[i]) = _initialGuess[i];
+                }
+            }
+            solution = solver->solveWithGuess(b.col(0), guess);
+            report.warmStarted = true;
+        } else {
+            solution = solver->solveBlock(b);
+        }
+        report.solveTime = timer.nsecsElapsed() / 1000000.0;
+        solver->fillReport(report);
+        return solution;
+    }
+
+    void FEMCalculator::fillSolution(const Mesh& mesh,
+                                     const Eigen::MatrixXd& solutionMatrix,
+                                     CalcSolution& solution) const {
+        INTCALC_TRACE_SCOPE("fillSolution");
+        const int verticesCount = mesh.verticesCount();
+        std::shared_ptr<SolutionData> data = std::make_shared<SolutionData>();
+        data->coordinates.resize(verticesCount * 2);
+        data->positions.resize(verticesCount * 2);
+        data->values.resize(verticesCount);
+        data->renderValues.resize(verticesCount);
+        float* positions = data->positions.data();
+        double* values = data->values.data();
+
+        // positions are stored relative to the bounds
+        if (verticesCount > 0) {
+            data->minX = data->maxX = mesh.x(0);
+            data->minY = data->maxY = mesh.y(0);
+            for (int i = 1; i < verticesCount; i++) {
+                data->minX = std::min(data->minX, mesh.x(i));
+                data->maxX = std::max(data->maxX, mesh.x(i));
+                data->minY = std::min(data->minY, mesh.y(i));
+                data->maxY = std::max(data->maxY, mesh.y(i));
+            }
+        }
+
+        Point2DValue minPoint;
+        minPoint.value = std::numeric_limits<double>::max();
+        int solIndex = 0;
+        for (int i = 0; i < verticesCount; i++) {
+            data->coordinates[2 * i] = mesh.x(i);
+            data->coordinates[2 * i + 1] = mesh.y(i);
+            positions[2 * i] = static_cast<float>(mesh.x(i) - data->minX);
+            positions[2 * i + 1] = static_cast<float>(mesh.y(i) - data->minY);
+            values[i] = 0;
+            if (mesh.type(i) != VertexInfo::Type::GAMMA_1) {
+                values[i] = solutionMatrix(solIndex, 0);
+                solIndex++;
+                if (_polutionSourceRegions.size() == 0 || mesh.hasFlag(i, Mesh::VertexFlag::IN_POLUTION_SOURCE_REGION)) {
+                    if (minPoint.value > values[i]) {
+                        minPoint.x = mesh.x(i);
+                        minPoint.y = mesh.y(i);
+                        minPoint.value = values[i];
+                        minPoint.isOnContour = mesh.type(i) != VertexInfo::Type::INNER;
+                    }
+                }
+            }
+            data->renderValues[i] = static_cast<float>(values[i]);
+        }
+
+        if (verticesCount > 0) {
+            const auto valueRange = std::minmax_element(values, values + verticesCount);
+            data->minValue = *valueRange.first;
+            data->maxValue = *valueRange.second;
+        }
+
+        const int* triangles = mesh.triangles();
+        if (mesh.cornersCount() == 3) {
+            data->indices.resize(mesh.trianglesCount() * 3);
+            std::copy(triangles, triangles + mesh.trianglesCount() * 3, data->indices.begin());
+        } else {
+            // quadratic triangles are drawn as the 4 linear triangles
+            // between their corners and midpoints
+            const int split[4][3] = { { 0, 5, 4 }, { 5, 1, 3 }, { 4, 3, 2 }, { 3, 4, 5 } };
+            data->indices.resize(mesh.trianglesCount() * 12);
+            for (int i = 0; i < mesh.trianglesCount(); i++) {
+                const int* triangle = mesh.triangle(i);
+                for (int part = 0; part < 4; part++) {
+                    for (int k = 0; k < 3; k++) {
+                        data->indices[12 * i + 3 * part + k] = triangle[split[part][k]];
+                    }
+                }
+            }
+        }
+        solution.data = data;
+
+        solution.minVertices.push_back(minPoint);
+
+        for (int area = 1; area < solutionMatrix.cols(); area++) {
+            QVector<double> field(mesh.verticesCount(), 0.0);
+            int row = 0;
+            for (int i = 0; i < mesh.verticesCount(); i++) {
+                if (mesh.type(i) != VertexInfo::Type::GAMMA_1) {
+                    field[i] = solutionMatrix(row, area);
+                    row++;
+                }
+            }
+            solution.areaFields.push_back(field);
+        }
+    }
+
+    QVector<CalcSolution> FEMCalculator::solveBatch(const QVector<ParameterSet>& parameterSets) {
+        INTCALC_TRACE_SCOPE("FEMCalculator::solveBatch");
+        QElapsedTimer timer;
+        timer.start();
+        SolveMetrics metrics;
+        qInfo() << "";
+        qInfo() << "Star batch of " << parameterSets.size() << " calculations...";
+        qInfo() << "-- riangulation switches: " << _triangulationSwitches;
+
+        requireDataNotNull();
+
+        startPhase(Phase::TRIANGULATION);
+        std::shared_ptr<const Mesh> meshHandle = prepareMesh(timer, metrics);
+        const Mesh& mesh = *meshHandle;
+
+        startPhase(Phase::ASSEMBLY);
+        const SplitOperators& operators = splitOperators(meshHandle);
+        metrics.assemblyTime = lap(timer);
+        qInfo() << "Prepared split operators (" << metrics.assemblyTime << "ms )";
+        const double sharedTime = metrics.triangulationTime + metrics.classificationTime + metrics.assemblyTime;
+
+        const Eigen::MatrixXd f = rightHandSides(mesh);
+        const QByteArray fingerprint = mesh.fingerprint();
+        QVector<CalcSolution> solutions;
+        solutions.reserve(parameterSets.size());
+        for (int i = 0; i < parameterSets.size(); i++) {
+            const ParameterSet& parameters = parameterSets[i];
+            startPhase(Phase::SOLVE, static_cast<double>(i) / parameterSets.size());
+            CalcSolution solution;
+            solution.metrics = metrics;
+            INTCALC_TRACE_SCOPE("parameter set");
+            SparseMatrix g = operators.combine(parameters);
+            Eigen::MatrixXd solutionMatrix = solveMatrix(g, mesh, f, solution.solverReport);
+            solution.metrics.solveTime = lap(timer);
+            fillSolution(mesh, solutionMatrix, solution);
+            solution.meshFingerprint = fingerprint;
+            solution.metrics.extractionTime = lap(timer);
+
+            solution.metrics.vertices = mesh.verticesCount();
+            solution.metrics.triangles = mesh.trianglesCount();
+            solution.metrics.unknowns = static_cast<int>(solutionMatrix.rows());
+            solution.metrics.nonZeros = g.nonZeros();
+            solution.metrics.solverName = solution.solverReport.solverName;
+            solution.metrics.iterations = solution.solverReport.iterations;
+            solution.metrics.processPeakMemory = intcalc_utils::peakResidentMemory();
+            solution.metrics.totalTime = sharedTime + solution.metrics.solveTime + solution.metrics.extractionTime;
+            _lastMetrics = solution.metrics;
+            solutions.push_back(solution);
+        }
+        startPhase(Phase::RESULT);
+        double solveTime = 0.0;
+        for (const CalcSolution& solution : solutions) {
+            solveTime += solution.metrics.solveTime + solution.metrics.extractionTime;
+        }
+        qInfo() << "Solved " << parameterSets.size() << " parameter sets (" << solveTime << "ms )";
+        qInfo() << "End.";
+        qInfo() << "";
+
+        return solutions;
+    }
+
+    SparseMatrix FEMCalculator::assembleGlobalMatrix() {
+        requireDataNotNull();
+        QElapsedTimer timer;
+        timer.start();
+        SolveMetrics metrics;
+        std::shared_ptr<const Mesh> meshHandle = prepareMesh(timer, metrics);
+        return M(*meshHandle);
     }
 
     CalcSolution FEMCalculator::solve() {
+        INTCALC_TRACE_SCOPE("FEMCalculator::solve");
+        QElapsedTimer total;
+        total.start();
         QElapsedTimer timer;
         timer.start();
+        SolveMetrics metrics;
         qInfo() << "";
         qInfo() << "Star calculations...";
         qInfo() << "Received parameters:";
@@ -256,71 +1273,135 @@ namespace intcalc {
 
         requireDataNotNull();
 
-        triangulateio out = intcalc_utils::doTriangulate(_triangulationSwitches, _regionOfStudy);
-        qInfo() << "Finish triangulation (" << timer.restart() << "ms )";
-        qInfo() << "--- numberofverticies: " << out.numberofpoints;
-        qInfo() << "--- numberoftriangles: " << out.numberoftriangles;
-
-        QVector<VertexInfo>* vertices = prepareDiscreteVerticies(out);
-        QVector<int*> triangles = prepareTrianglesVector(out);
-        qInfo() << "Prepared verticies (" << timer.restart() << "ms )";
+        startPhase(Phase::TRIANGULATION);
+        std::shared_ptr<const Mesh> meshHandle = prepareMesh(timer, metrics);
 
-        double** g = M(vertices, triangles);
-        qInfo() << "Calculated global matrix M (" << timer.restart() << "ms )";
-
-        Eigen::MatrixXd solutionMatrix = solveMatrix(g, vertices, [](const VertexInfo& vertex) ->double {
-            return vertex.isInConservacyArea() ? 1 : 0;
-        });
-        qInfo() << "Solved Au=f (" << timer.restart() << "ms )";
+        startPhase(Phase::ASSEMBLY);
+        SparseMatrix g = M(*meshHandle);
+        metrics.assemblyTime = lap(timer);
+        qInfo() << "Calculated global matrix M (" << metrics.assemblyTime << "ms )";
+        qInfo() << "--- nonzeros: " << g.nonZeros();
 
+        startPhase(Phase::SOLVE);
         CalcSolution solution;
-        Point2DValue minPoint;
-        minPoint.value = std::numeric_limits<double>::max();
-        int solIndex = 0;
-        for (auto vertex : *vertices) {
-            Point2DValue resultVertex;
-            resultVertex.x = vertex.x;
-            resultVertex.y = vertex.y;
-            resultVertex.value = 0;
-            if (vertex.type() != VertexInfo::Type::GAMMA_1) {
-                resultVertex.value = solutionMatrix(solIndex, 0);
-                solIndex++;
-                if (_polutionSourceRegions.size() == 0 || vertex.isInPolutionSourceRegion()) {
-                    if (minPoint.value > resultVertex.value) {
-                        minPoint.x = resultVertex.x;
-                        minPoint.y = resultVertex.y;
-                        minPoint.value = resultVertex.value;
-                    }
-                }
+        Eigen::MatrixXd solutionMatrix = solveMatrix(g, *meshHandle, rightHandSides(*meshHandle), solution.solverReport);
+        metrics.solveTime = lap(timer);
+        qInfo() << "Solved Au=f (" << metrics.solveTime << "ms )";
+        qInfo() << "--- solver: " << solution.solverReport.solverName;
+        qInfo() << "--- solver selection: " << solution.solverReport.selectionTime << "ms";
+        qInfo() << "--- factorization: " << solution.solverReport.factorizationTime << "ms";
+        qInfo() << "--- solve: " << solution.solverReport.solveTime << "ms";
+        if (solution.solverReport.iterations > 0) {
+            qInfo() << "--- iterations: " << solution.solverReport.iterations
+                    << (solution.solverReport.warmStarted ? "(warm start)" : "");
+            qInfo() << "--- residual: " << solution.solverReport.residualHistory.last();
+            if (!solution.solverReport.converged) {
+                qWarning() << "Iterative solver did not reach the tolerance of"
+                           << _iterativeSolverOptions.tolerance;
             }
-            if (vertex.type() == VertexInfo::Type::INNER) {
-                resultVertex.isOnContour = false;
-            }
-            solution.vertices.push_back(resultVertex);
         }
 
-        for (int i = 0; i < out.numberoftriangles; i++) {
-            for (int j = 0; j < 3; j++) {
-                solution.triangleIndices.push_back(triangles[i][j]);
-            }
+        if (_adaptiveOptions.maxIterations > 0) {
+            refineAdaptively(meshHandle, g, solutionMatrix, solution.solverReport, metrics, timer);
         }
+        const Mesh& mesh = *meshHandle;
 
-        solution.minVertices.push_back(minPoint);
-
-        // clean resources
-        free(out.trianglelist);
-        free(out.pointlist);
-        for (auto triangle : triangles) {
-            delete triangle;
+        startPhase(Phase::RESULT);
+        fillSolution(mesh, solutionMatrix, solution);
+        solution.meshFingerprint = mesh.fingerprint();
+        if (!solution.areaFields.isEmpty()) {
+            qInfo() << "--- area fields: " << solution.areaFields.size();
         }
 
-        qInfo() << "Displayed result (" << timer.restart() << "ms )";
+        metrics.extractionTime = lap(timer);
+        qInfo() << "Displayed result (" << metrics.extractionTime << "ms )";
+
+        metrics.vertices = mesh.verticesCount();
+        metrics.triangles = mesh.trianglesCount();
+        metrics.unknowns = static_cast<int>(solutionMatrix.rows());
+        metrics.nonZeros = g.nonZeros();
+        metrics.solverName = solution.solverReport.solverName;
+        metrics.iterations = solution.solverReport.iterations;
+        metrics.processPeakMemory = intcalc_utils::peakResidentMemory();
+        metrics.totalTime = total.nsecsElapsed() / 1000000.0;
+        solution.metrics = metrics;
+        _lastMetrics = metrics;
         qInfo() << "End.";
         qInfo() << "";
 
         return solution;
     }
 
+    namespace {
+        // solution in every vertex, gamma 1 vertices are 0
+        QVector<double> vertexValues(const Mesh& mesh, const Eigen::MatrixXd& solutionMatrix) {
+            QVector<double> values(mesh.verticesCount(), 0.0);
+            int row = 0;
+            for (int i = 0; i < mesh.verticesCount(); i++) {
+                if (mesh.type(i) != VertexInfo::Type::GAMMA_1) {
+                    values[i] = solutionMatrix(row, 0);
+                    row++;
+                }
+            }
+            return values;
+        }
+    }
+
+    // the times of every step are added to the metrics of the solve
+    void FEMCalculator::refineAdaptively(std::shared_ptr<const Mesh>& meshHandle,
+                                         SparseMatrix& g,
+                                         Eigen::MatrixXd& solutionMatrix,
+                                         SolverReport& report,
+                                         SolveMetrics& metrics,
+                                         QElapsedTimer& timer) {
+        INTCALC_TRACE_SCOPE("refineAdaptively");
+        for (int iteration = 0; ; iteration++) {
+            const Mesh& mesh = *meshHandle;
+            const ErrorEstimate estimate = estimateError(mesh, vertexValues(mesh, solutionMatrix));
+            metrics.estimatedError = estimate.relativeError();
+            qInfo() << "--- estimated error: " << metrics.estimatedError;
+            if (metrics.estimatedError <= _adaptiveOptions.tolerance
+                    || iteration >= _adaptiveOptions.maxIterations
+                    || mesh.verticesCount() >= _adaptiveOptions.maxVertices) {
+                return;
+            }
+
+            startPhase(Phase::TRIANGULATION);
+            triangulateio out = intcalc_utils::refineTriangulation(
+                        _refinementSwitches, mesh, refinementAreas(mesh, estimate, _adaptiveOptions.markingFraction));
+            std::shared_ptr<Mesh> refined;
+            {
+                INTCALC_TRACE_SCOPE("Mesh");
+                refined = std::make_shared<Mesh>(out);
+            }
+            metrics.triangulationTime += lap(timer);
+            prepareDiscreteVerticies(*refined);
+            metrics.classificationTime += lap(timer);
+            meshHandle = refined;
+            metrics.refinements++;
+            qInfo() << "Refined mesh, step " << metrics.refinements;
+            qInfo() << "--- numberofverticies: " << refined->verticesCount();
+            qInfo() << "--- numberoftriangles: " << refined->trianglesCount();
+
+            startPhase(Phase::ASSEMBLY);
+            g = M(*refined);
+            metrics.assemblyTime += lap(timer);
+
+            startPhase(Phase::SOLVE);
+            solutionMatrix = solveMatrix(g, *refined, rightHandSides(*refined), report);
+            metrics.solveTime += lap(timer);
+        }
+    }
+
+    void FEMCalculator::startPhase(Phase phase, double phaseProgress) {
+        if (_cancelled != nullptr && *_cancelled) {
+            throw "Calculation cancelled";
+        }
+        if (_progressCallback) {
+            _progressCallback(phase, phaseProgress);
+        }
+    }
+
     void FEMCalculator::requireDataNotNull() {
         if (_regionOfStudy.points() == nullptr) {
             throw "Can't calculate result, regionOfStudy not provided";
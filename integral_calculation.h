@@ -3,14 +3,27 @@
 
 #include <math.h>
 #include <eigen3/Eigen/Geometry>
+#include <eigen3/Eigen/Sparse>
 #include <limits>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <QDebug>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QVariantMap>
 
 #include "triangulate.h"
+#include "integral_calculation_elements.h"
+#include "integral_calculation_kernel.h"
+#include "integral_calculation_solvers.h"
 
 using std::pair;
 
 namespace intcalc {
+    typedef Eigen::Triplet<double> Triplet;
+
     struct Vector2d {
         double x;
         double y;
@@ -151,6 +164,140 @@ namespace intcalc {
         bool _isInPolutionSourceRegion;
     };
 
+    // triangulation of the region of study together with the classification
+    // of its vertices, owns all of its buffers
+    class Mesh {
+    public:
+        enum VertexFlag {
+            IN_CONSERVACY_AREA = 1,
+            IN_POLUTION_SOURCE_REGION = 2
+        };
+
+        // segment and vertex markers passed to the triangle library
+        enum BoundaryMarker {
+            NO_BOUNDARY = 0,
+            GAMMA_1_BOUNDARY = 1,
+            GAMMA_2_BOUNDARY = 2
+        };
+
+        // takes over the buffers of the triangle library output,
+        // the pointers in out are reset to nullptr; vertex types are
+        // taken from the boundary markers if there are any
+        explicit Mesh(triangulateio& out);
+        ~Mesh();
+
+        Mesh(const Mesh&) = delete;
+        Mesh& operator=(const Mesh&) = delete;
+
+        int verticesCount() const {
+            return static_cast<int>(_x.size());
+        }
+
+        int trianglesCount() const {
+            return _trianglesCount;
+        }
+
+        double x(int vertex) const {
+            return _x[vertex];
+        }
+
+        double y(int vertex) const {
+            return _y[vertex];
+        }
+
+        // nodes of a triangle, the corners first; quadratic triangles
+        // have the midpoints of their edges after them
+        const int* triangle(int index) const {
+            return _triangles + index * _corners;
+        }
+
+        const int* triangles() const {
+            return _triangles;
+        }
+
+        // nodes per triangle, 3 or 6
+        int cornersCount() const {
+            return _corners;
+        }
+
+        VertexInfo::Type type(int vertex) const {
+            return static_cast<VertexInfo::Type>(_types[vertex]);
+        }
+
+        // regional attribute of the triangle, 0 if it is not in any area
+        int triangleRegion(int index) const {
+            return _triangleRegions.empty() ? 0 : _triangleRegions[index];
+        }
+
+        // true if the boundary edges come from the edge list of the triangulation
+        bool hasEdgeTable() const {
+            return _hasEdgeTable;
+        }
+
+        // bit k is set if the edge opposite to corner k lies on gamma 2
+        uint8_t gamma2Edges(int index) const {
+            return _gamma2Edges[index];
+        }
+
+        int gamma2EdgesCount() const {
+            return _gamma2EdgesCount;
+        }
+
+        // boundary and area edges the triangulation was constrained to, split
+        // into mesh edges; kept to refine the mesh with the same constraints
+        int segmentsCount() const {
+            return static_cast<int>(_segmentMarkers.size());
+        }
+
+        const int* segment(int index) const {
+            return &_segments[index * 2];
+        }
+
+        int segmentMarker(int index) const {
+            return _segmentMarkers[index];
+        }
+
+        bool hasFlag(int vertex, VertexFlag flag) const {
+            return (_flags[vertex] & flag) != 0;
+        }
+
+        void setType(int vertex, VertexInfo::Type type) {
+            _types[vertex] = static_cast<uint8_t>(type);
+        }
+
+        void setFlag(int vertex, VertexFlag flag) {
+            _flags[vertex] |= flag;
+        }
+
+        VertexInfo vertex(int index) const;
+
+        // hash of the positions and triangles, equal for two meshes only
+        // if their vertices are the same and in the same order
+        QByteArray fingerprint() const;
+
+        // binary serialization for the on-disk mesh cache,
+        // read returns nullptr if the data is not a valid mesh
+        void write(QDataStream& stream) const;
+        static Mesh* read(QDataStream& stream);
+
+    private:
+        Mesh();
+
+        vector<double> _x;
+        vector<double> _y;
+        int* _triangles;
+        int _trianglesCount;
+        int _corners;
+        vector<uint8_t> _types;
+        vector<uint8_t> _flags;
+        vector<int> _triangleRegions;
+        bool _hasEdgeTable;
+        vector<uint8_t> _gamma2Edges;
+        int _gamma2EdgesCount;
+        vector<int> _segments;
+        vector<int> _segmentMarkers;
+    };
+
     class Region {
     public:
         Region()
@@ -246,6 +393,11 @@ namespace intcalc {
             return _points;
         }
 
+        bool boundsIntersect(const Region& other) const {
+            return _bottomLeft.x <= other._topRight.x && other._bottomLeft.x <= _topRight.x
+                    && _bottomLeft.y <= other._topRight.y && other._bottomLeft.y <= _topRight.y;
+        }
+
     private:
         const QVector<Vector2d>* _points;
         Vector2d _bottomLeft;
@@ -291,18 +443,206 @@ namespace intcalc {
         }
     };
 
+    // wall times in ms and sizes of one solve; in a batch the mesh and
+    // assembly times are shared by all solutions of the batch
+    struct SolveMetrics {
+        double triangulationTime;
+        double classificationTime;
+        double assemblyTime;
+        double solveTime;
+        double extractionTime;
+        double totalTime;
+        // triangulation and classification were skipped
+        bool meshFromCache;
+        int vertices;
+        int triangles;
+        int unknowns;
+        long long nonZeros;
+        QString solverName;
+        int iterations;
+        // high-water mark of the resident memory of the whole process at the
+        // end of the solve in bytes, it includes earlier and concurrent solves
+        // and never goes down; not the memory this solve needed
+        long long processPeakMemory;
+        // adaptive refinement steps, the mesh sizes are those of the last mesh
+        int refinements;
+        // estimated relative error of the solution, 0 without adaptive refinement
+        double estimatedError;
+
+        SolveMetrics()
+            : triangulationTime(0.0),
+              classificationTime(0.0),
+              assemblyTime(0.0),
+              solveTime(0.0),
+              extractionTime(0.0),
+              totalTime(0.0),
+              meshFromCache(false),
+              vertices(0),
+              triangles(0),
+              unknowns(0),
+              nonZeros(0),
+              iterations(0),
+              processPeakMemory(0),
+              refinements(0),
+              estimatedError(0.0) {
+        }
+
+        QVariantMap toVariantMap() const;
+        QJsonObject toJson() const;
+    };
+
+    // vertex data of a solution as structure of arrays, laid out
+    // so the renderer can upload the buffers without converting them
+    struct SolutionData {
+        // x and y of every vertex as triangulated, interleaved
+        QVector<double> coordinates;
+        // the same relative to minX and minY for the vertex buffer; floats
+        // keep their precision near the origin and are what GLES 2 draws
+        QVector<float> positions;
+        QVector<double> values;
+        // values as floats for the vertex buffer
+        QVector<float> renderValues;
+        QVector<unsigned int> indices;
+        // bounds of all vertices
+        double minX;
+        double minY;
+        double maxX;
+        double maxY;
+        double minValue;
+        double maxValue;
+
+        SolutionData()
+            : minX(0.0), minY(0.0), maxX(0.0), maxY(0.0), minValue(0.0), maxValue(0.0) {
+        }
+
+        int verticesCount() const {
+            return values.size();
+        }
+
+        int trianglesCount() const {
+            return indices.size() / 3;
+        }
+
+        double x(int i) const {
+            return coordinates[2 * i];
+        }
+
+        double y(int i) const {
+            return coordinates[2 * i + 1];
+        }
+    };
+
     struct CalcSolution {
-        QVector<Point2DValue> vertices;
-        QVector<int> triangleIndices;
+        // immutable once the solve is done, copies of the solution
+        // and the renderer share it
+        std::shared_ptr<const SolutionData> data;
         QVector<Point2DValue> minVertices;
+        SolverReport solverReport;
+        SolveMetrics metrics;
+        // Mesh::fingerprint of the triangulation of data
+        QByteArray meshFingerprint;
+        // influence field of every conservation area in vertex order, only
+        // filled if FEMCalculator::setComputeAreaFields is on
+        QVector<QVector<double>> areaFields;
+
+        // sum of weights[i] * areaFields[i], the solution for a right hand
+        // side with weight i in conservation area i
+        QVector<double> weightedAreaField(const QVector<double>& weights) const;
+
+        CalcSolution()
+            : data(std::make_shared<SolutionData>()) {
+        }
+    };
+
+    // physical parameters of one solve in a parameter sweep
+    struct ParameterSet {
+        double mu;
+        double sigma;
+        double alpha;
+        double betaX;
+        double betaY;
+
+        ParameterSet()
+            : mu(0.0), sigma(0.0), alpha(0.0), betaX(0.0), betaY(0.0) {
+        }
+
+        ParameterSet(double mu, double sigma, double alpha, double betaX, double betaY)
+            : mu(mu), sigma(sigma), alpha(alpha), betaX(betaX), betaY(betaY) {
+        }
+    };
+
+    // refinement of the mesh where the estimated error is largest, see
+    // FEMCalculator::setAdaptiveRefinement
+    struct AdaptiveRefinementOptions {
+        // refinement steps at most, 0 turns the refinement off
+        int maxIterations;
+        // estimated error relative to the norm of the solution gradient to stop at
+        double tolerance;
+        // no more refinement once the mesh has this many vertices
+        int maxVertices;
+        // share of the estimated error carried by the refined triangles
+        double markingFraction;
+
+        AdaptiveRefinementOptions()
+            : maxIterations(0), tolerance(0.05), maxVertices(200000), markingFraction(0.5) {
+        }
+    };
+
+    // global matrix M split into the parts that are linear in the parameters:
+    // M = mu * K - betaX * Cx - betaY * Cy + sigma * Mass
+    //     + alpha * E - betaX * Ex - betaY * Ey
+    // where E, Ex and Ey are the gamma 2 boundary terms. All parts share the
+    // same sparsity pattern, so combining them is a single pass over the values
+    struct SplitOperators {
+        enum Part {
+            K,
+            CX,
+            CY,
+            MASS,
+            E,
+            EX,
+            EY,
+            PARTS_COUNT
+        };
+
+        SparseMatrix parts[PARTS_COUNT];
+
+        SparseMatrix combine(const ParameterSet& parameters) const;
     };
 
     class FEMCalculator {
     public:
+        enum AssemblyKernel {
+            // m_ij for every entry, kept as the reference implementation
+            REFERENCE,
+            // whole element matrices for batches of triangles at once
+            FUSED
+        };
+
+        enum Phase {
+            TRIANGULATION,
+            ASSEMBLY,
+            SOLVE,
+            RESULT,
+            PHASES_COUNT
+        };
+
+        // phaseProgress is in [0, 1), only batches report progress inside a phase
+        typedef std::function<void(Phase phase, double phaseProgress)> ProgressCallback;
+
         FEMCalculator();
 
         CalcSolution solve();
 
+        // solves the same geometry for every parameter set, the parameters set
+        // with setMu, setSigma, setAlpha and setBeta are ignored; the split
+        // operators are assembled once per mesh and reused by later batches
+        QVector<CalcSolution> solveBatch(const QVector<ParameterSet>& parameterSets);
+
+        // global matrix M of the current geometry and parameters without
+        // solving, the tests compare the assembly kernels with it
+        SparseMatrix assembleGlobalMatrix();
+
         // TODO: rename to region of study or something else
         void setRegionOfStudy(const QVector<Vector2d>* rosPoints) {
             _regionOfStudy = Region(rosPoints, true);
@@ -340,18 +680,127 @@ namespace intcalc {
             _sigma = sigma;
         }
 
+        void setSolverType(LinearSolver::Type solverType) {
+            _solverType = solverType;
+        }
+
+        void setIterativeSolverOptions(const IterativeSolverOptions& options) {
+            _iterativeSolverOptions = options;
+        }
+
+        // warm start for iterative solvers, only used if the
+        // triangulation of the previous solution is the same
+        void setInitialGuess(const CalcSolution& previous) {
+            _initialGuess = previous.data->values;
+            _initialGuessMesh = previous.meshFingerprint;
+        }
+
+        // amount of threads used to assemble M, 0 means all cores;
+        // results are the same for any amount of threads
+        void setAssemblyThreads(int threads) {
+            _assemblyThreads = threads;
+        }
+
+        // meshes get at most one assembly thread per this many triangles,
+        // smaller ranges are not worth spawning a thread for
+        void setMinTrianglesPerThread(int minTrianglesPerThread) {
+            _minTrianglesPerThread = std::max(minTrianglesPerThread, 1);
+        }
+
+        // threads the last assembly ran on
+        int usedAssemblyThreads() const {
+            return _usedAssemblyThreads;
+        }
+
+        void setAssemblyKernel(AssemblyKernel assemblyKernel) {
+            _assemblyKernel = assemblyKernel;
+        }
+
+        // solve for every conservation area separately as well, with the
+        // same factorization as the main solution, see CalcSolution::areaFields;
+        // warm starts are only used without area fields
+        void setComputeAreaFields(bool computeAreaFields) {
+            _computeAreaFields = computeAreaFields;
+        }
+
+        // metrics of the last solve, or of the last solution of a batch
+        const SolveMetrics& lastMetrics() const {
+            return _lastMetrics;
+        }
+
+        // called on the thread running solve whenever a phase starts
+        void setProgressCallback(ProgressCallback progressCallback) {
+            _progressCallback = progressCallback;
+        }
+
+        // once the flag is set solve throws "Calculation cancelled" at the start
+        // of the next phase or iteration of an iterative solver; a direct
+        // factorization always runs to its end. The flag has to outlive the solve
+        void setCancelFlag(const std::atomic<bool>* cancelled) {
+            _cancelled = cancelled;
+        }
+
+        // solve starts on the mesh of setTriangulationOptions, estimates the error
+        // of every triangle and refines those with the largest error until the
+        // estimate is below the tolerance or the budget is used up; the solution
+        // is the one on the last mesh. Batches always use the initial mesh.
+        void setAdaptiveRefinement(const AdaptiveRefinementOptions& options) {
+            _adaptiveOptions = options;
+        }
+
+        // reuse triangulation and vertex classification of previous solves
+        // with the same geometry, see MeshCache
+        void setUseMeshCache(bool useMeshCache) {
+            _useMeshCache = useMeshCache;
+        }
+
         void setTriangulationOptions(double minAngle, double maxArea) {
-            _triangulationSwitches = QString("zq%0a%1")
+            // p - triangulate the planar straight line graph of all regions
+            // A - mark triangles with the attribute of the area they are in
+            // e - output the edges with their boundary markers
+            // o2 - add the edge midpoints as nodes for quadratic elements
+            const QString elementSwitch = ActiveElement::ORDER > 1 ? QString("o%0").arg(ActiveElement::ORDER) : QString();
+            _triangulationSwitches = QString("pzAe%0q%1a%2")
+                    .arg(elementSwitch)
                     .arg(minAngle)
                     .arg(QString::number(maxArea, 'f', 10));
+            // r - refine the previous mesh, a - with the area of every triangle
+            _refinementSwitches = QString("rpze%0q%1a").arg(elementSwitch).arg(minAngle);
         }
 
     private:
-        QVector<VertexInfo>* prepareDiscreteVerticies(triangulateio& out);
+        QByteArray meshKey() const;
+        std::shared_ptr<const Mesh> prepareMesh(QElapsedTimer& timer, SolveMetrics& metrics);
+        QVector<Region> meshAreas() const;
+        vector<bool> conformingAreas(const QVector<Region>& areas) const;
+        void prepareDiscreteVerticies(Mesh& mesh);
         double b(Vector2d edgeCenter);
+        double boundaryIntegral(int i, int j, const DiscreteElement& el, vector<int>& edges);
         double m_ij(int i, int j, const DiscreteElement& el, vector<int>& edges);
-        void m(double** g, const DiscreteElement& el, const int* idx);
-        double** M(QVector<VertexInfo>* vertices, QVector<int*> triangles);
+        vector<int> boundaryEdges(const Mesh& mesh, int index, const DiscreteElement& el) const;
+        // bit k is set if the edge opposite to corner k lies on gamma 2
+        uint8_t gamma2EdgeMask(const Mesh& mesh, int index) const;
+        void m(vector<Triplet>& triplets, const DiscreteElement& el, const int* idx, vector<int>& edges);
+        void mFused(vector<Triplet>& triplets, const ElementBatch& batch, int e, const Mesh& mesh, int index);
+        void assembleFused(vector<Triplet>& triplets, const Mesh& mesh, int begin, int end);
+        int assemblyThreadsCount(int trianglesCount) const;
+        void assembleInParallel(int trianglesCount, std::function<void(int part, int begin, int end)> assembleRange);
+        SparseMatrix M(const Mesh& mesh);
+        void refineAdaptively(std::shared_ptr<const Mesh>& meshHandle,
+                              SparseMatrix& g,
+                              Eigen::MatrixXd& solutionMatrix,
+                              SolverReport& report,
+                              SolveMetrics& metrics,
+                              QElapsedTimer& timer);
+        const SplitOperators& splitOperators(std::shared_ptr<const Mesh> mesh);
+        void assembleSplitOperators(const Mesh& mesh, SplitOperators& operators);
+        void fillSolution(const Mesh& mesh, const Eigen::MatrixXd& solutionMatrix, CalcSolution& solution) const;
+        Eigen::MatrixXd rightHandSides(const Mesh& mesh) const;
+        Eigen::MatrixXd solveMatrix(const SparseMatrix& g,
+                                    const Mesh& mesh,
+                                    const Eigen::MatrixXd& f,
+                                    SolverReport& report);
+        void startPhase(Phase phase, double phaseProgress = 0.0);
         void requireDataNotNull();
 
         Region _regionOfStudy;
@@ -364,6 +813,24 @@ namespace intcalc {
         double _sigma;
         Vector2d _beta;
         QString _triangulationSwitches;
+        QString _refinementSwitches;
+        AdaptiveRefinementOptions _adaptiveOptions;
+        LinearSolver::Type _solverType;
+        IterativeSolverOptions _iterativeSolverOptions;
+        QVector<double> _initialGuess;
+        QByteArray _initialGuessMesh;
+        int _assemblyThreads;
+        int _minTrianglesPerThread;
+        int _usedAssemblyThreads;
+        AssemblyKernel _assemblyKernel;
+        bool _useMeshCache;
+        bool _computeAreaFields;
+        SolveMetrics _lastMetrics;
+        ProgressCallback _progressCallback;
+        const std::atomic<bool>* _cancelled;
+        // mesh the split operators were assembled for
+        std::shared_ptr<const Mesh> _operatorsMesh;
+        SplitOperators _operators;
     };
 }
 
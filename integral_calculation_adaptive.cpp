@@ -0,0 +1,111 @@
+#include "integral_calculation_adaptive.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "integral_calculation_trace.h"
+
+namespace intcalc {
+    namespace {
+        double triangleArea(const Mesh& mesh, const int* triangle) {
+            return fabs((mesh.x(triangle[1]) - mesh.x(triangle[0])) * (mesh.y(triangle[2]) - mesh.y(triangle[0]))
+                    - (mesh.x(triangle[2]) - mesh.x(triangle[0])) * (mesh.y(triangle[1]) - mesh.y(triangle[0]))) / 2.0;
+        }
+
+        // constant gradient of the linear interpolation on the triangle
+        Vector2d triangleGradient(const Mesh& mesh, const int* triangle, const QVector<double>& values) {
+            const double x0 = mesh.x(triangle[0]);
+            const double y0 = mesh.y(triangle[0]);
+            const double x1 = mesh.x(triangle[1]);
+            const double y1 = mesh.y(triangle[1]);
+            const double x2 = mesh.x(triangle[2]);
+            const double y2 = mesh.y(triangle[2]);
+            const double u0 = values[triangle[0]];
+            const double u1 = values[triangle[1]];
+            const double u2 = values[triangle[2]];
+            const double jacobian = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+            if (jacobian == 0.0) {
+                return Vector2d();
+            }
+            return Vector2d(u0 * (y1 - y2) + u1 * (y2 - y0) + u2 * (y0 - y1),
+                            u0 * (x2 - x1) + u1 * (x0 - x2) + u2 * (x1 - x0)) / jacobian;
+        }
+    }
+
+    ErrorEstimate estimateError(const Mesh& mesh, const QVector<double>& values) {
+        INTCALC_TRACE_SCOPE("estimateError");
+        if (values.size() != mesh.verticesCount()) {
+            throw "Amount of values differs from the amount of vertices!";
+        }
+
+        const int trianglesCount = mesh.trianglesCount();
+        vector<Vector2d> gradients(trianglesCount);
+        vector<double> areas(trianglesCount);
+        vector<Vector2d> recovered(mesh.verticesCount());
+        vector<double> weights(mesh.verticesCount(), 0.0);
+        double squaredNorm = 0.0;
+        for (int i = 0; i < trianglesCount; i++) {
+            const int* triangle = mesh.triangle(i);
+            gradients[i] = triangleGradient(mesh, triangle, values);
+            areas[i] = triangleArea(mesh, triangle);
+            squaredNorm += areas[i] * (gradients[i] * gradients[i]);
+            for (int k = 0; k < 3; k++) {
+                recovered[triangle[k]].x += areas[i] * gradients[i].x;
+                recovered[triangle[k]].y += areas[i] * gradients[i].y;
+                weights[triangle[k]] += areas[i];
+            }
+        }
+        for (int i = 0; i < mesh.verticesCount(); i++) {
+            if (weights[i] > 0) {
+                recovered[i] = recovered[i] / weights[i];
+            }
+        }
+
+        ErrorEstimate estimate;
+        estimate.squaredErrors.resize(trianglesCount);
+        double squaredError = 0.0;
+        for (int i = 0; i < trianglesCount; i++) {
+            const int* triangle = mesh.triangle(i);
+            double sum = 0.0;
+            for (int k = 0; k < 3; k++) {
+                Vector2d difference(recovered[triangle[k]].x - gradients[i].x,
+                                    recovered[triangle[k]].y - gradients[i].y);
+                sum += difference * difference;
+            }
+            estimate.squaredErrors[i] = areas[i] / 3.0 * sum;
+            squaredError += estimate.squaredErrors[i];
+        }
+        estimate.error = sqrt(squaredError);
+        estimate.norm = sqrt(squaredNorm);
+        return estimate;
+    }
+
+    // Doerfler marking, the fewest triangles that carry the requested share of the error
+    vector<double> refinementAreas(const Mesh& mesh, const ErrorEstimate& estimate, double markingFraction) {
+        const int trianglesCount = mesh.trianglesCount();
+        vector<double> maxAreas(trianglesCount, -1.0);
+        if (static_cast<int>(estimate.squaredErrors.size()) != trianglesCount) {
+            throw "Error estimate doesn't belong to the mesh!";
+        }
+
+        vector<int> order(trianglesCount);
+        for (int i = 0; i < trianglesCount; i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&estimate](int a, int b) {
+            return estimate.squaredErrors[a] > estimate.squaredErrors[b];
+        });
+
+        const double target = markingFraction * estimate.error * estimate.error;
+        double marked = 0.0;
+        for (int i = 0; i < trianglesCount && marked < target; i++) {
+            const int index = order[i];
+            if (estimate.squaredErrors[index] <= 0) {
+                break;
+            }
+            maxAreas[index] = triangleArea(mesh, mesh.triangle(index)) / 2.0;
+            marked += estimate.squaredErrors[index];
+        }
+        return maxAreas;
+    }
+}
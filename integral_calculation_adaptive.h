@@ -0,0 +1,41 @@
+#ifndef INTEGRAL_CALCULATION_ADAPTIVE_H
+#define INTEGRAL_CALCULATION_ADAPTIVE_H
+
+#include <QVector>
+
+#include "integral_calculation.h"
+
+namespace intcalc {
+    // a posteriori estimate of the error of a solution in the energy norm
+    struct ErrorEstimate {
+        // squared error indicator of every triangle
+        vector<double> squaredErrors;
+        double error;
+        // norm of the gradient of the solution
+        double norm;
+
+        ErrorEstimate()
+            : error(0.0), norm(0.0) {
+        }
+
+        double relativeError() const {
+            return norm > 0 ? error / norm : 0.0;
+        }
+    };
+
+    // Zienkiewicz-Zhu estimate of a linear solution with a value in every vertex:
+    // the gradient in a vertex is recovered as the area weighted mean of the
+    // constant gradients of its triangles, the indicator of a triangle is the
+    // difference between the recovered gradient and its own, integrated
+    // with the vertex rule. Only the corners of a triangle are used, on
+    // quadratic meshes this estimates the linear interpolant of the solution
+    // and ignores the midpoints, so it only guides the refinement
+    ErrorEstimate estimateError(const Mesh& mesh, const QVector<double>& values);
+
+    // area limits for Triangle's refinement: the triangles with the largest
+    // indicators that make up markingFraction of the squared error together
+    // are limited to half of their area, the other triangles get -1
+    vector<double> refinementAreas(const Mesh& mesh, const ErrorEstimate& estimate, double markingFraction);
+}
+
+#endif // INTEGRAL_CALCULATION_ADAPTIVE_H
@@ -0,0 +1,173 @@
+#include "integral_calculation_cache.h"
+
+#include <algorithm>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace intcalc {
+    namespace {
+        // increase when the layout written by Mesh::write changes
+        const quint32 DISK_FORMAT_MAGIC = 0x4d455348;
+        const quint32 DISK_FORMAT_VERSION = 3;
+    }
+
+    MeshCache& MeshCache::instance() {
+        static MeshCache cache;
+        return cache;
+    }
+
+    MeshCache::MeshCache()
+        : _capacity(4),
+          _diskStorePath(QString::fromLocal8Bit(qgetenv("INTCALC_MESH_CACHE_DIR"))),
+          _hits(0),
+          _misses(0),
+          _diskHits(0) {
+    }
+
+    // the files are read and written without holding the lock,
+    // so lookups of other solves don't wait for the disk
+    std::shared_ptr<const Mesh> MeshCache::find(const QByteArray& key) {
+        QString fileName;
+        {
+            QMutexLocker locker(&_mutex);
+            for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+                if (it->first == key) {
+                    _entries.splice(_entries.begin(), _entries, it);
+                    _hits++;
+                    return _entries.front().second;
+                }
+            }
+            fileName = diskFileName(key);
+        }
+
+        std::shared_ptr<const Mesh> mesh = loadFromDisk(fileName);
+        QMutexLocker locker(&_mutex);
+        if (mesh) {
+            insertInMemory(key, mesh);
+            _hits++;
+            _diskHits++;
+        } else {
+            _misses++;
+        }
+        return mesh;
+    }
+
+    void MeshCache::insert(const QByteArray& key, std::shared_ptr<const Mesh> mesh) {
+        QString fileName;
+        {
+            QMutexLocker locker(&_mutex);
+            insertInMemory(key, mesh);
+            fileName = diskFileName(key);
+        }
+        storeOnDisk(fileName, *mesh);
+    }
+
+    void MeshCache::setCapacity(int capacity) {
+        QMutexLocker locker(&_mutex);
+        _capacity = std::max(capacity, 0);
+        while (static_cast<int>(_entries.size()) > _capacity) {
+            _entries.pop_back();
+        }
+    }
+
+    void MeshCache::setDiskStorePath(const QString& path) {
+        QMutexLocker locker(&_mutex);
+        _diskStorePath = path;
+    }
+
+    void MeshCache::clear() {
+        QMutexLocker locker(&_mutex);
+        _entries.clear();
+        _hits = 0;
+        _misses = 0;
+        _diskHits = 0;
+    }
+
+    int MeshCache::hits() const {
+        QMutexLocker locker(&_mutex);
+        return _hits;
+    }
+
+    int MeshCache::misses() const {
+        QMutexLocker locker(&_mutex);
+        return _misses;
+    }
+
+    int MeshCache::diskHits() const {
+        QMutexLocker locker(&_mutex);
+        return _diskHits;
+    }
+
+    void MeshCache::insertInMemory(const QByteArray& key, std::shared_ptr<const Mesh> mesh) {
+        for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->first == key) {
+                _entries.erase(it);
+                break;
+            }
+        }
+        if (_capacity == 0) {
+            return;
+        }
+        _entries.emplace_front(key, mesh);
+        while (static_cast<int>(_entries.size()) > _capacity) {
+            _entries.pop_back();
+        }
+    }
+
+    QString MeshCache::diskFileName(const QByteArray& key) const {
+        if (_diskStorePath.isEmpty()) {
+            return QString();
+        }
+        return QDir(_diskStorePath).filePath(QString::fromLatin1(key.toHex()) + ".mesh");
+    }
+
+    std::shared_ptr<const Mesh> MeshCache::loadFromDisk(const QString& fileName) {
+        if (fileName.isEmpty()) {
+            return nullptr;
+        }
+
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return nullptr;
+        }
+
+        QDataStream stream(&file);
+        quint32 magic = 0;
+        quint32 version = 0;
+        stream >> magic >> version;
+        if (magic != DISK_FORMAT_MAGIC || version != DISK_FORMAT_VERSION) {
+            return nullptr;
+        }
+
+        std::shared_ptr<const Mesh> mesh(Mesh::read(stream));
+        if (!mesh) {
+            qWarning() << "Ignoring corrupted mesh cache file" << file.fileName();
+        }
+        return mesh;
+    }
+
+    void MeshCache::storeOnDisk(const QString& fileName, const Mesh& mesh) {
+        if (fileName.isEmpty() || !QDir().mkpath(QFileInfo(fileName).path())) {
+            return;
+        }
+
+        // QSaveFile writes a temporary file and renames it on commit,
+        // a reader never sees a half written mesh
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Can't write mesh cache file" << file.fileName();
+            return;
+        }
+
+        QDataStream stream(&file);
+        stream << DISK_FORMAT_MAGIC << DISK_FORMAT_VERSION;
+        mesh.write(stream);
+        if (stream.status() != QDataStream::Ok || !file.commit()) {
+            qWarning() << "Can't write mesh cache file" << file.fileName();
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef INTEGRAL_CALCULATION_CACHE_H
+#define INTEGRAL_CALCULATION_CACHE_H
+
+#include <list>
+#include <memory>
+#include <utility>
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+#include "integral_calculation.h"
+
+namespace intcalc {
+    // Triangulated and classified meshes of previous solves, keyed by a hash of
+    // the geometry and the triangulation switches. Meshes are kept in memory
+    // (least recently used are dropped first) and, if a directory is set,
+    // stored on disk so they survive restarts of the application.
+    // The directory can also be given by the INTCALC_MESH_CACHE_DIR variable.
+    class MeshCache {
+    public:
+        static MeshCache& instance();
+
+        MeshCache(const MeshCache&) = delete;
+        MeshCache& operator=(const MeshCache&) = delete;
+
+        // nullptr if there is no mesh with this key in memory or on disk
+        std::shared_ptr<const Mesh> find(const QByteArray& key);
+        void insert(const QByteArray& key, std::shared_ptr<const Mesh> mesh);
+
+        void setCapacity(int capacity);
+        void setDiskStorePath(const QString& path);
+        void clear();
+
+        int hits() const;
+        int misses() const;
+        int diskHits() const;
+
+    private:
+        MeshCache();
+
+        // empty if there is no disk store
+        QString diskFileName(const QByteArray& key) const;
+        static std::shared_ptr<const Mesh> loadFromDisk(const QString& fileName);
+        static void storeOnDisk(const QString& fileName, const Mesh& mesh);
+        void insertInMemory(const QByteArray& key, std::shared_ptr<const Mesh> mesh);
+
+        mutable QMutex _mutex;
+        // most recently used first
+        std::list<std::pair<QByteArray, std::shared_ptr<const Mesh>>> _entries;
+        int _capacity;
+        QString _diskStorePath;
+        int _hits;
+        int _misses;
+        int _diskHits;
+    };
+}
+
+#endif // INTEGRAL_CALCULATION_CACHE_H
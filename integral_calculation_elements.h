@@ -0,0 +1,212 @@
+#ifndef INTEGRAL_CALCULATION_ELEMENTS_H
+#define INTEGRAL_CALCULATION_ELEMENTS_H
+
+#include <math.h>
+
+namespace intcalc {
+    // point of a quadrature rule on the triangle in barycentric coordinates,
+    // the weights of a rule sum up to 1 and are scaled with the area
+    struct QuadraturePoint {
+        double l[3];
+        double weight;
+    };
+
+    namespace quadrature {
+        // k-th point of the orbit of (1 - 2a, a, a) under the permutations of the corners
+        constexpr QuadraturePoint orbit(double a, double weight, int k) {
+            return k == 0 ? QuadraturePoint{ { 1 - 2 * a, a, a }, weight }
+                 : k == 1 ? QuadraturePoint{ { a, 1 - 2 * a, a }, weight }
+                          : QuadraturePoint{ { a, a, 1 - 2 * a }, weight };
+        }
+
+        constexpr double weightsSum(const QuadraturePoint* points, int count) {
+            return count == 0 ? 0.0 : points[0].weight + weightsSum(points + 1, count - 1);
+        }
+
+        // Dunavant rule of degree 4, exact for the mass matrix of quadratic elements
+        constexpr QuadraturePoint TRIANGLE[] = {
+            orbit(0.445948490915965, 0.223381589678011, 0),
+            orbit(0.445948490915965, 0.223381589678011, 1),
+            orbit(0.445948490915965, 0.223381589678011, 2),
+            orbit(0.091576213509771, 0.109951743655322, 0),
+            orbit(0.091576213509771, 0.109951743655322, 1),
+            orbit(0.091576213509771, 0.109951743655322, 2)
+        };
+        constexpr int TRIANGLE_SIZE = sizeof(TRIANGLE) / sizeof(QuadraturePoint);
+
+        static_assert(weightsSum(TRIANGLE, TRIANGLE_SIZE) > 1 - 1e-12 && weightsSum(TRIANGLE, TRIANGLE_SIZE) < 1 + 1e-12,
+                      "Weights of the triangle rule have to sum up to 1");
+
+        // Gauss-Legendre rule with 3 points on [0, 1], exact up to degree 5,
+        // {position, weight}
+        constexpr double EDGE[][2] = {
+            { 0.112701665379258311, 5.0 / 18.0 },
+            { 0.5, 8.0 / 18.0 },
+            { 0.887298334620741689, 5.0 / 18.0 }
+        };
+        constexpr int EDGE_SIZE = sizeof(EDGE) / sizeof(EDGE[0]);
+    }
+
+    // integrals over one triangle without the coefficients of the equation,
+    // entry [i][j] couples the test function of node i with the trial function of node j
+    template<typename Element>
+    struct ElementMatrices {
+        // grad N_i * grad N_j
+        double stiffness[Element::NODES][Element::NODES];
+        // N_i * dN_j / dx and N_i * dN_j / dy
+        double convectionX[Element::NODES][Element::NODES];
+        double convectionY[Element::NODES][Element::NODES];
+        // N_i * N_j
+        double mass[Element::NODES][Element::NODES];
+    };
+
+    // gradients of the barycentric coordinates, constant on the triangle
+    inline double barycentricGradients(const double x[3], const double y[3], double gradients[3][2]) {
+        const double jacobian = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        gradients[0][0] = (y[1] - y[2]) / jacobian;
+        gradients[0][1] = (x[2] - x[1]) / jacobian;
+        gradients[1][0] = (y[2] - y[0]) / jacobian;
+        gradients[1][1] = (x[0] - x[2]) / jacobian;
+        gradients[2][0] = (y[0] - y[1]) / jacobian;
+        gradients[2][1] = (x[1] - x[0]) / jacobian;
+        return jacobian;
+    }
+
+    // element matrices of any element with shape and shapeGradients
+    template<typename Element>
+    void integrateWithQuadrature(const double x[3], const double y[3], ElementMatrices<Element>& matrices) {
+        const int nodes = Element::NODES;
+        double lambdaGradients[3][2];
+        const double area = fabs(barycentricGradients(x, y, lambdaGradients)) / 2.0;
+
+        for (int i = 0; i < nodes; i++) {
+            for (int j = 0; j < nodes; j++) {
+                matrices.stiffness[i][j] = 0.0;
+                matrices.convectionX[i][j] = 0.0;
+                matrices.convectionY[i][j] = 0.0;
+                matrices.mass[i][j] = 0.0;
+            }
+        }
+
+        for (int q = 0; q < quadrature::TRIANGLE_SIZE; q++) {
+            const QuadraturePoint& point = quadrature::TRIANGLE[q];
+            double n[nodes];
+            double g[nodes][2];
+            Element::shape(point.l, n);
+            Element::shapeGradients(point.l, lambdaGradients, g);
+            const double weight = point.weight * area;
+            for (int i = 0; i < nodes; i++) {
+                for (int j = 0; j < nodes; j++) {
+                    matrices.stiffness[i][j] += weight * (g[i][0] * g[j][0] + g[i][1] * g[j][1]);
+                    matrices.convectionX[i][j] += weight * n[i] * g[j][0];
+                    matrices.convectionY[i][j] += weight * n[i] * g[j][1];
+                    matrices.mass[i][j] += weight * n[i] * n[j];
+                }
+            }
+        }
+    }
+
+    // N_i * N_j over the edge opposite to corner edge, the shape functions
+    // of nodes that are not on the edge vanish there
+    template<typename Element>
+    void integrateEdgeWithQuadrature(int edge, double length, double matrix[Element::NODES][Element::NODES]) {
+        const int nodes = Element::NODES;
+        for (int i = 0; i < nodes; i++) {
+            for (int j = 0; j < nodes; j++) {
+                matrix[i][j] = 0.0;
+            }
+        }
+
+        for (int q = 0; q < quadrature::EDGE_SIZE; q++) {
+            const double t = quadrature::EDGE[q][0];
+            double l[3];
+            l[edge] = 0.0;
+            l[(edge + 1) % 3] = 1 - t;
+            l[(edge + 2) % 3] = t;
+            double n[nodes];
+            Element::shape(l, n);
+            const double weight = quadrature::EDGE[q][1] * length;
+            for (int i = 0; i < nodes; i++) {
+                for (int j = 0; j < nodes; j++) {
+                    matrix[i][j] += weight * n[i] * n[j];
+                }
+            }
+        }
+    }
+
+    // linear triangle, nodes are the corners
+    struct LinearElement {
+        static const int NODES = 3;
+        // o switch of the triangle library
+        static const int ORDER = 1;
+
+        // closed forms, the same terms as firstIntegral, secondIntegral and thirdIntegral
+        static void integrate(const double x[3], const double y[3], ElementMatrices<LinearElement>& matrices) {
+            double g[3][2];
+            const double jacobian = barycentricGradients(x, y, g);
+            for (int i = 0; i < NODES; i++) {
+                for (int j = 0; j < NODES; j++) {
+                    matrices.stiffness[i][j] = (fabs(jacobian) / 2.0) * (g[i][0] * g[j][0] + g[i][1] * g[j][1]);
+                    matrices.convectionX[i][j] = g[j][0] * (fabs(jacobian) / 6.0);
+                    matrices.convectionY[i][j] = g[j][1] * (fabs(jacobian) / 6.0);
+                    matrices.mass[i][j] = i == j ? fabs(jacobian) / 12.0 : fabs(jacobian) / 24.0;
+                }
+            }
+        }
+
+        // same as fourthIntegral
+        static void integrateEdge(int edge, double length, double matrix[NODES][NODES]) {
+            for (int i = 0; i < NODES; i++) {
+                for (int j = 0; j < NODES; j++) {
+                    if (i == edge || j == edge) {
+                        matrix[i][j] = 0;
+                    } else {
+                        matrix[i][j] = i == j ? length / 3 : length / 6;
+                    }
+                }
+            }
+        }
+    };
+
+    // quadratic triangle, corners followed by the midpoints of the edges
+    // opposite to corner 0, 1 and 2, the node order of the triangle library
+    struct QuadraticElement {
+        static const int NODES = 6;
+        static const int ORDER = 2;
+
+        static void shape(const double l[3], double n[NODES]) {
+            for (int k = 0; k < 3; k++) {
+                n[k] = l[k] * (2 * l[k] - 1);
+                n[3 + k] = 4 * l[(k + 1) % 3] * l[(k + 2) % 3];
+            }
+        }
+
+        static void shapeGradients(const double l[3], const double lambdaGradients[3][2], double g[NODES][2]) {
+            for (int k = 0; k < 3; k++) {
+                const int a = (k + 1) % 3;
+                const int b = (k + 2) % 3;
+                for (int d = 0; d < 2; d++) {
+                    g[k][d] = (4 * l[k] - 1) * lambdaGradients[k][d];
+                    g[3 + k][d] = 4 * (l[a] * lambdaGradients[b][d] + l[b] * lambdaGradients[a][d]);
+                }
+            }
+        }
+
+        static void integrate(const double x[3], const double y[3], ElementMatrices<QuadraticElement>& matrices) {
+            integrateWithQuadrature<QuadraticElement>(x, y, matrices);
+        }
+
+        static void integrateEdge(int edge, double length, double matrix[NODES][NODES]) {
+            integrateEdgeWithQuadrature<QuadraticElement>(edge, length, matrix);
+        }
+    };
+
+    // element of the assembly, qmake CONFIG+=intcalc_p2 for quadratic elements
+#ifdef INTCALC_P2
+    typedef QuadraticElement ActiveElement;
+#else
+    typedef LinearElement ActiveElement;
+#endif
+}
+
+#endif // INTEGRAL_CALCULATION_ELEMENTS_H
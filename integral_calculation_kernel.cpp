@@ -0,0 +1,55 @@
+#include "integral_calculation_kernel.h"
+
+#include <math.h>
+
+#if defined(__GNUC__) && !defined(__clang__) && !defined(INTCALC_DEBUG)
+// -O2 does not vectorize the batch loop with the default cost model
+#pragma GCC optimize("O3")
+#endif
+
+// gcc builds an AVX2 and a generic scalar version of the kernel
+// and picks one at load time depending on the cpu
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__)
+#define INTCALC_KERNEL_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define INTCALC_KERNEL_TARGETS
+#endif
+
+namespace intcalc {
+    // std::min takes SIZE by reference, which needs a definition before C++17
+    constexpr int ElementBatch::SIZE;
+
+    INTCALC_KERNEL_TARGETS
+    void computeElementMatrices(ElementBatch& batch, const ElementCoefficients& c) {
+        for (int e = 0; e < ElementBatch::SIZE; e++) {
+            const double x0 = batch.x[0][e];
+            const double x1 = batch.x[1][e];
+            const double x2 = batch.x[2][e];
+            const double y0 = batch.y[0][e];
+            const double y1 = batch.y[1][e];
+            const double y2 = batch.y[2][e];
+
+            // nablaPhi(i) multiplied by the jacobian
+            const double gx[3] = { y1 - y2, y2 - y0, y0 - y1 };
+            const double gy[3] = { x2 - x1, x0 - x2, x1 - x0 };
+
+            const double jacobian = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+            const double area = fabs(jacobian);
+
+            // mu * |J| / 2 * (g_i / J) * (g_j / J)
+            const double stiffness = c.mu / (2.0 * area);
+            // beta * (g_j / J) * |J| / 6
+            const double advection = copysign(1.0, jacobian) / 6.0;
+            const double massDiagonal = c.sigma * area / 12.0;
+            const double massOffDiagonal = c.sigma * area / 24.0;
+
+            for (int j = 0; j < 3; j++) {
+                const double convection = advection * (c.betaX * gx[j] + c.betaY * gy[j]);
+                for (int i = 0; i < 3; i++) {
+                    const double mass = i == j ? massDiagonal : massOffDiagonal;
+                    batch.m[i * 3 + j][e] = stiffness * (gx[i] * gx[j] + gy[i] * gy[j]) - convection + mass;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef INTEGRAL_CALCULATION_KERNEL_H
+#define INTEGRAL_CALCULATION_KERNEL_H
+
+namespace intcalc {
+    // coefficients of the volume integrals of m_ij
+    struct ElementCoefficients {
+        double mu;
+        double sigma;
+        double betaX;
+        double betaY;
+    };
+
+    // geometry and resulting 3x3 element matrices of a batch of triangles
+    // in structure of arrays layout, so the kernel loop over the batch
+    // can be vectorized
+    struct ElementBatch {
+        static constexpr int SIZE = 8;
+
+        double x[3][SIZE];
+        double y[3][SIZE];
+        // m[i * 3 + j][e] is m_ij of element e without the boundary terms
+        double m[9][SIZE];
+    };
+
+    // fused version of the mu * firstIntegral - beta * secondIntegral
+    // + sigma * thirdIntegral part of m_ij for all 9 entries at once
+    void computeElementMatrices(ElementBatch& batch, const ElementCoefficients& c);
+}
+
+#endif // INTEGRAL_CALCULATION_KERNEL_H
@@ -0,0 +1,159 @@
+#include "integral_calculation_lod.h"
+
+#include <math.h>
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include "integral_calculation_trace.h"
+
+namespace intcalc {
+    namespace {
+        // a level has to drop at least this share of the triangles of the previous one
+        const double MIN_REDUCTION = 0.3;
+
+        struct ClusterTriangle {
+            // sorted, to find triangles that collapsed onto the same clusters
+            unsigned int key[3];
+            // original orientation
+            unsigned int vertices[3];
+
+            bool operator<(const ClusterTriangle& other) const {
+                return std::lexicographical_compare(key, key + 3, other.key, other.key + 3);
+            }
+
+            bool operator==(const ClusterTriangle& other) const {
+                return std::equal(key, key + 3, other.key);
+            }
+        };
+
+        std::shared_ptr<SolutionData> clusterVertices(const SolutionData& solution,
+                                                      double cellSize,
+                                                      int minVertex,
+                                                      int maxVertex) {
+            INTCALC_TRACE_SCOPE("clusterVertices");
+            const int verticesCount = solution.verticesCount();
+            const long long columns = static_cast<long long>((solution.maxX - solution.minX) / cellSize) + 1;
+
+            // clusters are numbered in the order their first vertex appears
+            std::unordered_map<long long, int> cellClusters;
+            vector<int> clusterOf(verticesCount);
+            vector<double> sumX;
+            vector<double> sumY;
+            vector<int> counts;
+            // positions are relative to minX and minY
+            const float* positions = solution.positions.constData();
+            for (int i = 0; i < verticesCount; i++) {
+                const long long column = static_cast<long long>(positions[2 * i] / cellSize);
+                const long long row = static_cast<long long>(positions[2 * i + 1] / cellSize);
+                auto inserted = cellClusters.insert(std::make_pair(row * columns + column, static_cast<int>(counts.size())));
+                if (inserted.second) {
+                    sumX.push_back(0.0);
+                    sumY.push_back(0.0);
+                    counts.push_back(0);
+                }
+                const int cluster = inserted.first->second;
+                clusterOf[i] = cluster;
+                sumX[cluster] += positions[2 * i];
+                sumY[cluster] += positions[2 * i + 1];
+                counts[cluster]++;
+            }
+
+            // every cluster is represented by its vertex closest to the centroid,
+            // except for the clusters of the extremes
+            const int clustersCount = static_cast<int>(counts.size());
+            vector<int> representative(clustersCount, -1);
+            vector<double> distance(clustersCount, std::numeric_limits<double>::max());
+            for (int i = 0; i < verticesCount; i++) {
+                const int cluster = clusterOf[i];
+                const double dx = positions[2 * i] - sumX[cluster] / counts[cluster];
+                const double dy = positions[2 * i + 1] - sumY[cluster] / counts[cluster];
+                if (dx * dx + dy * dy < distance[cluster]) {
+                    distance[cluster] = dx * dx + dy * dy;
+                    representative[cluster] = i;
+                }
+            }
+            representative[clusterOf[maxVertex]] = maxVertex;
+            representative[clusterOf[minVertex]] = minVertex;
+
+            std::shared_ptr<SolutionData> level = std::make_shared<SolutionData>();
+            // the level has the bounds of the solution, so the
+            // relative positions are copied as they are
+            level->coordinates.resize(clustersCount * 2);
+            level->positions.resize(clustersCount * 2);
+            level->values.resize(clustersCount);
+            level->renderValues.resize(clustersCount);
+            for (int cluster = 0; cluster < clustersCount; cluster++) {
+                const int vertex = representative[cluster];
+                level->coordinates[2 * cluster] = solution.x(vertex);
+                level->coordinates[2 * cluster + 1] = solution.y(vertex);
+                level->positions[2 * cluster] = positions[2 * vertex];
+                level->positions[2 * cluster + 1] = positions[2 * vertex + 1];
+                level->values[cluster] = solution.values[vertex];
+                level->renderValues[cluster] = solution.renderValues[vertex];
+            }
+
+            // triangles with two corners in the same cluster degenerate
+            vector<ClusterTriangle> triangles;
+            triangles.reserve(solution.trianglesCount());
+            for (int i = 0; i < solution.trianglesCount(); i++) {
+                ClusterTriangle triangle;
+                for (int k = 0; k < 3; k++) {
+                    triangle.vertices[k] = static_cast<unsigned int>(clusterOf[solution.indices[3 * i + k]]);
+                    triangle.key[k] = triangle.vertices[k];
+                }
+                std::sort(triangle.key, triangle.key + 3);
+                if (triangle.key[0] == triangle.key[1] || triangle.key[1] == triangle.key[2]) {
+                    continue;
+                }
+                triangles.push_back(triangle);
+            }
+            std::sort(triangles.begin(), triangles.end());
+            triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+
+            level->indices.resize(static_cast<int>(triangles.size()) * 3);
+            for (size_t i = 0; i < triangles.size(); i++) {
+                std::copy(triangles[i].vertices, triangles[i].vertices + 3, level->indices.begin() + 3 * i);
+            }
+
+            level->minX = solution.minX;
+            level->minY = solution.minY;
+            level->maxX = solution.maxX;
+            level->maxY = solution.maxY;
+            level->minValue = solution.minValue;
+            level->maxValue = solution.maxValue;
+            return level;
+        }
+    }
+
+    QVector<LodLevel> buildLodLevels(const SolutionData& solution, int minTriangles) {
+        INTCALC_TRACE_SCOPE("buildLodLevels");
+        QVector<LodLevel> levels;
+        const double width = solution.maxX - solution.minX;
+        const double height = solution.maxY - solution.minY;
+        if (solution.trianglesCount() <= minTriangles || width <= 0 || height <= 0) {
+            return levels;
+        }
+
+        const int minVertex = static_cast<int>(std::min_element(solution.values.begin(), solution.values.end())
+                                               - solution.values.begin());
+        const int maxVertex = static_cast<int>(std::max_element(solution.values.begin(), solution.values.end())
+                                               - solution.values.begin());
+
+        // twice the edge of a triangle if they covered the bounding box evenly
+        double cellSize = 2 * sqrt(2 * width * height / solution.trianglesCount());
+        int trianglesCount = solution.trianglesCount();
+        while (trianglesCount > minTriangles && cellSize < std::max(width, height)) {
+            std::shared_ptr<SolutionData> data = clusterVertices(solution, cellSize, minVertex, maxVertex);
+            if (data->trianglesCount() <= trianglesCount * (1 - MIN_REDUCTION)) {
+                LodLevel level;
+                level.data = data;
+                level.cellSize = cellSize;
+                levels.push_back(level);
+                trianglesCount = data->trianglesCount();
+            }
+            cellSize *= 2;
+        }
+        return levels;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef INTEGRAL_CALCULATION_LOD_H
+#define INTEGRAL_CALCULATION_LOD_H
+
+#include <memory>
+#include <QVector>
+
+#include "integral_calculation.h"
+
+namespace intcalc {
+    // simplified copy of a solution for drawing it from far away
+    struct LodLevel {
+        std::shared_ptr<const SolutionData> data;
+        // size of the clustering grid cells, triangles of the level
+        // are about this size in solution coordinates
+        double cellSize;
+
+        LodLevel()
+            : cellSize(0.0) {
+        }
+    };
+
+    // Builds coarser and coarser versions of the solution by clustering its
+    // vertices on grids with doubling cell size, until a level has fewer than
+    // minTriangles triangles. Every cluster is replaced by one of its own
+    // vertices, so the values of a level are solver values, and the vertices
+    // with the min and the max value are kept in every level. Returns nothing
+    // for solutions that are already small. Doesn't touch the GL context, runs
+    // on any thread.
+    QVector<LodLevel> buildLodLevels(const SolutionData& solution, int minTriangles);
+}
+
+#endif // INTEGRAL_CALCULATION_LOD_H
@@ -0,0 +1,292 @@
+#include "integral_calculation_solvers.h"
+
+#include <math.h>
+#include <limits>
+
+namespace intcalc {
+    bool SparseLUSolver::factorize(const SparseMatrix& a) {
+        _lu.compute(a);
+        return _lu.info() == Eigen::Success;
+    }
+
+    Eigen::VectorXd SparseLUSolver::solve(const Eigen::VectorXd& b) {
+        return _lu.solve(b);
+    }
+
+    Eigen::MatrixXd SparseLUSolver::solveBlock(const Eigen::MatrixXd& b) {
+        return _lu.solve(b);
+    }
+
+    bool SparseLDLTSolver::factorize(const SparseMatrix& a) {
+        _ldlt.compute(a);
+        return _ldlt.info() == Eigen::Success;
+    }
+
+    Eigen::VectorXd SparseLDLTSolver::solve(const Eigen::VectorXd& b) {
+        return _ldlt.solve(b);
+    }
+
+    Eigen::MatrixXd SparseLDLTSolver::solveBlock(const Eigen::MatrixXd& b) {
+        return _ldlt.solve(b);
+    }
+
+    bool IncompleteLU0::compute(const SparseMatrix& a) {
+        _lu = a;
+        _lu.makeCompressed();
+
+        const int n = static_cast<int>(_lu.rows());
+        const int* outer = _lu.outerIndexPtr();
+        const int* inner = _lu.innerIndexPtr();
+        double* values = _lu.valuePtr();
+
+        _diagonal.assign(n, -1);
+        for (int i = 0; i < n; i++) {
+            for (int p = outer[i]; p < outer[i + 1]; p++) {
+                if (inner[p] == i) {
+                    _diagonal[i] = p;
+                    break;
+                }
+            }
+            if (_diagonal[i] < 0) {
+                return false;
+            }
+        }
+
+        // position of column j in the current row, -1 if the row has no such entry
+        std::vector<int> position(n, -1);
+        for (int i = 0; i < n; i++) {
+            for (int p = outer[i]; p < outer[i + 1]; p++) {
+                position[inner[p]] = p;
+            }
+
+            for (int p = outer[i]; p < _diagonal[i]; p++) {
+                const int k = inner[p];
+                values[p] /= values[_diagonal[k]];
+                for (int q = _diagonal[k] + 1; q < outer[k + 1]; q++) {
+                    if (position[inner[q]] >= 0) {
+                        values[position[inner[q]]] -= values[p] * values[q];
+                    }
+                }
+            }
+
+            for (int p = outer[i]; p < outer[i + 1]; p++) {
+                position[inner[p]] = -1;
+            }
+
+            if (values[_diagonal[i]] == 0.0) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    Eigen::VectorXd IncompleteLU0::solve(const Eigen::VectorXd& b) const {
+        const int n = static_cast<int>(_lu.rows());
+        const int* outer = _lu.outerIndexPtr();
+        const int* inner = _lu.innerIndexPtr();
+        const double* values = _lu.valuePtr();
+
+        Eigen::VectorXd x = b;
+        for (int i = 0; i < n; i++) {
+            for (int p = outer[i]; p < _diagonal[i]; p++) {
+                x(i) -= values[p] * x(inner[p]);
+            }
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            for (int p = _diagonal[i] + 1; p < outer[i + 1]; p++) {
+                x(i) -= values[p] * x(inner[p]);
+            }
+            x(i) /= values[_diagonal[i]];
+        }
+        return x;
+    }
+
+    QString BiCGSTABSolver::name() const {
+        if (_options.preconditioner == IterativeSolverOptions::Preconditioner::ILU0) {
+            return "BiCGSTAB+ILU0";
+        }
+        return "BiCGSTAB+ILUT";
+    }
+
+    bool BiCGSTABSolver::factorize(const SparseMatrix& a) {
+        _a = &a;
+        if (_options.preconditioner == IterativeSolverOptions::Preconditioner::ILU0) {
+            return _ilu0.compute(a);
+        }
+
+        _ilut.setDroptol(_options.ilutDropTolerance);
+        _ilut.setFillfactor(_options.ilutFillFactor);
+        _ilut.compute(a);
+        return _ilut.info() == Eigen::Success;
+    }
+
+    Eigen::VectorXd BiCGSTABSolver::precondition(const Eigen::VectorXd& v) const {
+        if (_options.preconditioner == IterativeSolverOptions::Preconditioner::ILU0) {
+            return _ilu0.solve(v);
+        }
+        return _ilut.solve(v);
+    }
+
+    Eigen::VectorXd BiCGSTABSolver::solve(const Eigen::VectorXd& b) {
+        return solveWithGuess(b, Eigen::VectorXd::Zero(b.size()));
+    }
+
+    Eigen::MatrixXd BiCGSTABSolver::solveBlock(const Eigen::MatrixXd& b) {
+        // the report sums the iterations of all columns and
+        // keeps the residual history of the first one
+        Eigen::MatrixXd x(b.rows(), b.cols());
+        QVector<double> firstHistory;
+        int iterations = 0;
+        bool converged = true;
+        for (int k = 0; k < b.cols(); k++) {
+            x.col(k) = solve(b.col(k));
+            iterations += _iterations;
+            converged = converged && _converged;
+            if (k == 0) {
+                firstHistory = _residualHistory;
+            }
+        }
+        _iterations = iterations;
+        _converged = converged;
+        _residualHistory = firstHistory;
+        return x;
+    }
+
+    Eigen::VectorXd BiCGSTABSolver::solveWithGuess(const Eigen::VectorXd& b, const Eigen::VectorXd& guess) {
+        if (_a == nullptr) {
+            throw "BiCGSTAB solver used before factorize!";
+        }
+
+        const SparseMatrix& a = *_a;
+        const double eps = std::numeric_limits<double>::epsilon();
+        _iterations = 0;
+        _converged = false;
+        _residualHistory.clear();
+
+        Eigen::VectorXd x = guess;
+        const double bNorm = b.norm();
+        if (bNorm == 0.0) {
+            _converged = true;
+            return Eigen::VectorXd::Zero(b.size());
+        }
+
+        Eigen::VectorXd r = b - a * x;
+        Eigen::VectorXd r0 = r;
+        double r0SquaredNorm = r0.squaredNorm();
+        double rho = 1;
+        double alpha = 1;
+        double w = 1;
+        Eigen::VectorXd v = Eigen::VectorXd::Zero(b.size());
+        Eigen::VectorXd p = Eigen::VectorXd::Zero(b.size());
+
+        if (r.norm() / bNorm <= _options.tolerance) {
+            _converged = true;
+            return x;
+        }
+
+        // restarts with the current residual, a second breakdown
+        // before the iteration completes can't be recovered from
+        bool restarted = false;
+        auto restart = [&]() {
+            if (restarted) {
+                throw "BiCGSTAB broke down";
+            }
+            restarted = true;
+            r = b - a * x;
+            r0 = r;
+            rho = r0SquaredNorm = r.squaredNorm();
+            v.setZero();
+            p.setZero();
+            alpha = 1;
+            w = 1;
+        };
+
+        while (_iterations < _options.maxIterations) {
+            if (_options.cancelled != nullptr && *_options.cancelled) {
+                throw "Calculation cancelled";
+            }
+
+            double rhoOld = rho;
+            rho = r0.dot(r);
+            if (fabs(rho) < eps * eps * r0SquaredNorm) {
+                // r0 became too orthogonal to r
+                restart();
+            }
+
+            double beta = (rho / rhoOld) * (alpha / w);
+            p = r + beta * (p - w * v);
+
+            Eigen::VectorXd y = precondition(p);
+            v = a * y;
+            const double r0v = r0.dot(v);
+            if (fabs(r0v) <= eps * sqrt(r0SquaredNorm) * v.norm()) {
+                // r0 is orthogonal to A p, alpha would be inf or NaN
+                restart();
+                continue;
+            }
+            alpha = rho / r0v;
+            Eigen::VectorXd s = r - alpha * v;
+
+            Eigen::VectorXd z = precondition(s);
+            Eigen::VectorXd t = a * z;
+            double tSquaredNorm = t.squaredNorm();
+            w = tSquaredNorm > 0 ? t.dot(s) / tSquaredNorm : 0;
+
+            x += alpha * y + w * z;
+            r = s - w * t;
+            _iterations++;
+            restarted = false;
+
+            double residual = r.norm() / bNorm;
+            _residualHistory.push_back(residual);
+            if (residual <= _options.tolerance) {
+                _converged = true;
+                break;
+            }
+        }
+
+        return x;
+    }
+
+    void BiCGSTABSolver::fillReport(SolverReport& report) const {
+        report.iterations = _iterations;
+        report.converged = _converged;
+        report.residualHistory = _residualHistory;
+    }
+
+    namespace {
+        // relative to the norm of the matrix, rounding of the assembly
+        // leaves symmetric operators slightly asymmetric
+        const double SYMMETRY_TOLERANCE = 0.000000001;
+    }
+
+    bool isSymmetric(const SparseMatrix& a) {
+        if (a.rows() != a.cols()) {
+            return false;
+        }
+
+        SparseMatrix transposed = a.transpose();
+        return (a - transposed).norm() <= SYMMETRY_TOLERANCE * a.norm();
+    }
+
+    LinearSolver* createLinearSolver(LinearSolver::Type type,
+                                     const SparseMatrix& a,
+                                     const IterativeSolverOptions& options) {
+        switch (type) {
+        case LinearSolver::Type::SPARSE_LU:
+            return new SparseLUSolver();
+        case LinearSolver::Type::SPARSE_LDLT:
+            return new SparseLDLTSolver();
+        case LinearSolver::Type::BICGSTAB:
+            return new BiCGSTABSolver(options);
+        case LinearSolver::Type::AUTO:
+            break;
+        }
+
+        if (isSymmetric(a)) {
+            return new SparseLDLTSolver();
+        }
+        return new SparseLUSolver();
+    }
+}
@@ -0,0 +1,178 @@
+#ifndef INTEGRAL_CALCULATION_SOLVERS_H
+#define INTEGRAL_CALCULATION_SOLVERS_H
+
+#include <atomic>
+#include <eigen3/Eigen/Sparse>
+#include <QString>
+#include <QVector>
+
+namespace intcalc {
+    typedef Eigen::SparseMatrix<double> SparseMatrix;
+
+    // what happened during the last solve of Au=f
+    struct SolverReport {
+        QString solverName;
+        // successful factorization of the solver that solved the system
+        double factorizationTime;
+        // symmetry check of the automatic selection and factorizations
+        // that failed before the fallback to SparseLU
+        double selectionTime;
+        double solveTime;
+        int iterations;
+        bool converged;
+        bool warmStarted;
+        // relative residual ||b - Ax|| / ||b|| after each iteration
+        QVector<double> residualHistory;
+
+        SolverReport()
+            : factorizationTime(0.0),
+              selectionTime(0.0),
+              solveTime(0.0),
+              iterations(0),
+              converged(true),
+              warmStarted(false) {
+        }
+    };
+
+    struct IterativeSolverOptions {
+        enum Preconditioner {
+            ILU0,
+            ILUT
+        };
+
+        double tolerance;
+        int maxIterations;
+        Preconditioner preconditioner;
+        double ilutDropTolerance;
+        int ilutFillFactor;
+        // checked every iteration, the solve throws once it is set
+        const std::atomic<bool>* cancelled;
+
+        IterativeSolverOptions()
+            : tolerance(0.00000001),
+              maxIterations(1000),
+              preconditioner(ILUT),
+              ilutDropTolerance(0.0001),
+              ilutFillFactor(10),
+              cancelled(nullptr) {
+        }
+    };
+
+    // backend for solving the reduced system, factorize is called once
+    // per matrix and solve may be called for any amount of right hand sides
+    class LinearSolver {
+    public:
+        enum Type {
+            AUTO,
+            SPARSE_LU,
+            SPARSE_LDLT,
+            BICGSTAB
+        };
+
+        virtual ~LinearSolver() {
+        }
+
+        virtual QString name() const = 0;
+        virtual bool factorize(const SparseMatrix& a) = 0;
+        virtual Eigen::VectorXd solve(const Eigen::VectorXd& b) = 0;
+
+        // a solve for every column of b with the same factorization
+        virtual Eigen::MatrixXd solveBlock(const Eigen::MatrixXd& b) {
+            Eigen::MatrixXd x(b.rows(), b.cols());
+            for (int k = 0; k < b.cols(); k++) {
+                x.col(k) = solve(b.col(k));
+            }
+            return x;
+        }
+
+        // only iterative solvers make use of the guess
+        virtual Eigen::VectorXd solveWithGuess(const Eigen::VectorXd& b, const Eigen::VectorXd& guess) {
+            Q_UNUSED(guess)
+            return solve(b);
+        }
+
+        virtual void fillReport(SolverReport& report) const {
+            Q_UNUSED(report)
+        }
+    };
+
+    class SparseLUSolver : public LinearSolver {
+    public:
+        QString name() const override {
+            return "SparseLU";
+        }
+
+        bool factorize(const SparseMatrix& a) override;
+        Eigen::VectorXd solve(const Eigen::VectorXd& b) override;
+        Eigen::MatrixXd solveBlock(const Eigen::MatrixXd& b) override;
+
+    private:
+        Eigen::SparseLU<SparseMatrix, Eigen::COLAMDOrdering<int>> _lu;
+    };
+
+    // works only for symmetric matrices, reads the lower triangle
+    class SparseLDLTSolver : public LinearSolver {
+    public:
+        QString name() const override {
+            return "SparseLDLT";
+        }
+
+        bool factorize(const SparseMatrix& a) override;
+        Eigen::VectorXd solve(const Eigen::VectorXd& b) override;
+        Eigen::MatrixXd solveBlock(const Eigen::MatrixXd& b) override;
+
+    private:
+        Eigen::SimplicialLDLT<SparseMatrix> _ldlt;
+    };
+
+    // ILU(0), the factors keep the sparsity pattern of the matrix
+    class IncompleteLU0 {
+    public:
+        bool compute(const SparseMatrix& a);
+        Eigen::VectorXd solve(const Eigen::VectorXd& b) const;
+
+    private:
+        Eigen::SparseMatrix<double, Eigen::RowMajor> _lu;
+        std::vector<int> _diagonal;
+    };
+
+    // right preconditioned BiCGSTAB, suitable for the nonsymmetric
+    // systems we get from the advection term
+    class BiCGSTABSolver : public LinearSolver {
+    public:
+        explicit BiCGSTABSolver(const IterativeSolverOptions& options)
+            : _options(options),
+              _a(nullptr),
+              _iterations(0),
+              _converged(false) {
+        }
+
+        QString name() const override;
+        bool factorize(const SparseMatrix& a) override;
+        Eigen::VectorXd solve(const Eigen::VectorXd& b) override;
+        Eigen::MatrixXd solveBlock(const Eigen::MatrixXd& b) override;
+        Eigen::VectorXd solveWithGuess(const Eigen::VectorXd& b, const Eigen::VectorXd& guess) override;
+        void fillReport(SolverReport& report) const override;
+
+    private:
+        Eigen::VectorXd precondition(const Eigen::VectorXd& v) const;
+
+        IterativeSolverOptions _options;
+        const SparseMatrix* _a;
+        IncompleteLU0 _ilu0;
+        Eigen::IncompleteLUT<double> _ilut;
+        int _iterations;
+        bool _converged;
+        QVector<double> _residualHistory;
+    };
+
+    bool isSymmetric(const SparseMatrix& a);
+
+    // creates a solver of the given type, AUTO picks LDLT for
+    // symmetric matrices (no advection, _beta = 0) and LU otherwise
+    LinearSolver* createLinearSolver(LinearSolver::Type type,
+                                     const SparseMatrix& a,
+                                     const IterativeSolverOptions& options);
+}
+
+#endif // INTEGRAL_CALCULATION_SOLVERS_H
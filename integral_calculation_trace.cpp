@@ -0,0 +1,116 @@
+#include "integral_calculation_trace.h"
+
+#ifdef INTCALC_TRACE
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <QDebug>
+#include <QFile>
+
+namespace intcalc_trace {
+    namespace {
+        struct Span {
+            const char* name;
+            long long start;
+            long long duration;
+        };
+
+        // every thread appends to its own buffer, the mutex is only
+        // contended while the trace is written
+        struct ThreadBuffer {
+            int threadId;
+            std::mutex mutex;
+            std::vector<Span> spans;
+        };
+
+        struct Registry {
+            std::mutex mutex;
+            // kept after the threads exit, assembly threads are short lived
+            std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        };
+
+        Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        ThreadBuffer& threadBuffer() {
+            thread_local std::shared_ptr<ThreadBuffer> buffer;
+            if (!buffer) {
+                buffer = std::make_shared<ThreadBuffer>();
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                buffer->threadId = static_cast<int>(r.buffers.size()) + 1;
+                r.buffers.push_back(buffer);
+            }
+            return *buffer;
+        }
+
+        // microseconds since the first span, the unit of the trace format
+        long long now() {
+            static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - epoch).count();
+        }
+    }
+
+    TraceScope::TraceScope(const char* name)
+        : _name(name),
+          _start(now()) {
+    }
+
+    TraceScope::~TraceScope() {
+        Span span;
+        span.name = _name;
+        span.start = _start;
+        span.duration = now() - _start;
+
+        ThreadBuffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        buffer.spans.push_back(span);
+    }
+
+    bool writeChromeTrace(const QString& fileName) {
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+
+        file.write("{\"traceEvents\":[\n");
+        bool first = true;
+        Registry& r = registry();
+        std::lock_guard<std::mutex> registryLock(r.mutex);
+        for (auto& buffer : r.buffers) {
+            std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+            for (const Span& span : buffer->spans) {
+                // complete events, the viewer nests them by time per thread
+                file.write(QString("%1{\"name\":\"%2\",\"ph\":\"X\",\"pid\":1,\"tid\":%3,\"ts\":%4,\"dur\":%5}")
+                           .arg(first ? "" : ",\n")
+                           .arg(span.name)
+                           .arg(buffer->threadId)
+                           .arg(span.start)
+                           .arg(span.duration)
+                           .toUtf8());
+                first = false;
+            }
+        }
+        file.write("\n],\"displayTimeUnit\":\"ms\"}\n");
+        return file.error() == QFileDevice::NoError;
+    }
+
+    void finish() {
+        QString fileName = QString::fromLocal8Bit(qgetenv("INTCALC_TRACE_FILE"));
+        if (fileName.isEmpty()) {
+            fileName = "intcalc_trace.json";
+        }
+        if (writeChromeTrace(fileName)) {
+            qInfo() << "Trace written to" << fileName;
+        } else {
+            qWarning() << "Can't write trace to" << fileName;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef INTEGRAL_CALCULATION_TRACE_H
+#define INTEGRAL_CALCULATION_TRACE_H
+
+// Scoped spans for a Chrome trace (chrome://tracing, Perfetto) of the solve.
+// Built only with CONFIG+=intcalc_trace, otherwise the macros expand to nothing.
+//
+//     INTCALC_TRACE_SCOPE("assembly");
+//
+// marks the time until the end of the enclosing block. INTCALC_TRACE_FINISH()
+// writes every span recorded so far to INTCALC_TRACE_FILE (intcalc_trace.json
+// by default), it is called once before the application exits.
+
+#ifdef INTCALC_TRACE
+
+#include <QString>
+
+namespace intcalc_trace {
+    class TraceScope {
+    public:
+        // name has to be a string literal, only the pointer is kept
+        explicit TraceScope(const char* name);
+        ~TraceScope();
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+        const char* _name;
+        long long _start;
+    };
+
+    // returns false if the file can't be written
+    bool writeChromeTrace(const QString& fileName);
+
+    void finish();
+}
+
+#define INTCALC_TRACE_CONCAT_(a, b) a##b
+#define INTCALC_TRACE_CONCAT(a, b) INTCALC_TRACE_CONCAT_(a, b)
+#define INTCALC_TRACE_SCOPE(name) intcalc_trace::TraceScope INTCALC_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define INTCALC_TRACE_FINISH() intcalc_trace::finish()
+
+#else
+
+#define INTCALC_TRACE_SCOPE(name) ((void) 0)
+#define INTCALC_TRACE_FINISH() ((void) 0)
+
+#endif
+
+#endif // INTEGRAL_CALCULATION_TRACE_H
@@ -1,5 +1,15 @@
 #include "integral_calculation_utils.h"
 
+#include <algorithm>
+#include <map>
+#include <QtGlobal>
+
+#include "integral_calculation_trace.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
 
 bool intcalc_utils::onSegment(intcalc::Vector2d p, intcalc::Vector2d q, intcalc::Vector2d r) {
     if (q.x <= std::max(p.x, r.x) && q.x >= std::min(p.x, r.x)
@@ -67,21 +77,315 @@ bool intcalc_utils::onLine(intcalc::Vector2d a, intcalc::Vector2d b, intcalc::Ve
     return abs(diff) <= 0.000000001;
 }
 
-triangulateio intcalc_utils::doTriangulate(QString triangulationSwitches, intcalc::Region& regionOfStudy) {
-    vector<TriangulatePoint> triangulationIn;
-    const QVector<intcalc::Vector2d>* points = regionOfStudy.points();
-    for (int i = 0; i < points->size(); i++) {
-        TriangulatePoint point;
-        point.x = points->at(i).x;
-        point.y = points->at(i).y;
-        triangulationIn.push_back(point);
+namespace {
+    // gamma 2 end points closer to a contour edge than this share of the
+    // edge length are on the edge and split it
+    const double ON_CONTOUR_TOLERANCE = 0.000001;
+
+    // closed paths from the map repeat the first point at the end
+    int contourSize(const QVector<intcalc::Vector2d>* points) {
+        int size = points->size();
+        if (size > 1 && points->first().x == points->last().x && points->first().y == points->last().y) {
+            size--;
+        }
+        return size;
+    }
+
+    double distanceToSegment(const intcalc::Vector2d& p, const intcalc::Vector2d& a, const intcalc::Vector2d& b) {
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        double lengthSquared = dx * dx + dy * dy;
+        if (lengthSquared == 0.0) {
+            return p.distanceTo(a);
+        }
+        double t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared;
+        t = std::max(0.0, std::min(1.0, t));
+        return p.distanceTo(intcalc::Vector2d(a.x + t * dx, a.y + t * dy));
+    }
+
+    // adds the point unless there already is one with the same coordinates
+    int addPoint(vector<TriangulatePoint>& points,
+                 std::map<std::pair<double, double>, int>& indices,
+                 const intcalc::Vector2d& point,
+                 int marker) {
+        auto key = std::make_pair(point.x, point.y);
+        auto found = indices.find(key);
+        if (found != indices.end()) {
+            return found->second;
+        }
+
+        TriangulatePoint triangulatePoint;
+        triangulatePoint.x = point.x;
+        triangulatePoint.y = point.y;
+        triangulatePoint.marker = marker;
+        points.push_back(triangulatePoint);
+        indices[key] = static_cast<int>(points.size()) - 1;
+        return indices[key];
+    }
+}
+
+bool intcalc_utils::isInsideRegion(const intcalc::Region& area, const intcalc::Region& region) {
+    const QVector<intcalc::Vector2d>* areaPoints = area.points();
+    const QVector<intcalc::Vector2d>* regionPoints = region.points();
+    const int areaSize = contourSize(areaPoints);
+    const int regionSize = contourSize(regionPoints);
+    for (int i = 0; i < areaSize; i++) {
+        if (!region.hasVertexInside(areaPoints->at(i)) || region.hasVertexOnContour(areaPoints->at(i))) {
+            return false;
+        }
+    }
+    for (int i = 0; i < areaSize; i++) {
+        const intcalc::Vector2d& a = areaPoints->at(i);
+        const intcalc::Vector2d& b = areaPoints->at((i + 1) % areaSize);
+        for (int j = 0; j < regionSize; j++) {
+            const intcalc::Vector2d& c = regionPoints->at(j);
+            const intcalc::Vector2d& d = regionPoints->at((j + 1) % regionSize);
+            if (intcalc::Vector2d::_doIntersect(a, b, c, d)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool intcalc_utils::findInteriorPoint(const intcalc::Region& region, intcalc::Vector2d& point) {
+    const QVector<intcalc::Vector2d>* points = region.points();
+    const int size = contourSize(points);
+    for (int i = 0; i < size; i++) {
+        const intcalc::Vector2d& a = points->at(i);
+        const intcalc::Vector2d& b = points->at((i + 1) % size);
+        // step a bit to both sides of the edge center
+        double offset = a.distanceTo(b) * 0.001;
+        if (offset == 0.0) {
+            continue;
+        }
+        double nx = -(b.y - a.y) / a.distanceTo(b) * offset;
+        double ny = (b.x - a.x) / a.distanceTo(b) * offset;
+        intcalc::Vector2d center((a.x + b.x) / 2.0, (a.y + b.y) / 2.0);
+        intcalc::Vector2d candidates[2] = {
+            intcalc::Vector2d(center.x + nx, center.y + ny),
+            intcalc::Vector2d(center.x - nx, center.y - ny)
+        };
+        for (auto candidate : candidates) {
+            if (region.hasVertexInside(candidate) && !region.hasVertexOnContour(candidate)) {
+                point = candidate;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+triangulateio intcalc_utils::doTriangulate(QString triangulationSwitches,
+                                           const intcalc::Region& regionOfStudy,
+                                           const intcalc::Region& gamma2,
+                                           const QVector<intcalc::Region>& areas,
+                                           const vector<bool>& conformingAreas) {
+    INTCALC_TRACE_SCOPE("doTriangulate");
+    const QVector<intcalc::Vector2d>* rosPoints = regionOfStudy.points();
+    QVector<intcalc::Vector2d> contour;
+    for (int i = 0; i < contourSize(rosPoints); i++) {
+        contour.push_back(rosPoints->at(i));
+    }
+
+    // gamma 2 may start and end in the middle of a contour edge,
+    // those points have to be on the contour to split it
+    if (gamma2.points() != nullptr) {
+        for (auto point : *gamma2.points()) {
+            int closestEdge = -1;
+            double closestDistance = std::numeric_limits<double>::max();
+            for (int i = 0; i < contour.size(); i++) {
+                double distance = distanceToSegment(point, contour[i], contour[(i + 1) % contour.size()]);
+                if (distance < closestDistance) {
+                    closestDistance = distance;
+                    closestEdge = i;
+                }
+            }
+
+            const intcalc::Vector2d& a = contour[closestEdge];
+            const intcalc::Vector2d& b = contour[(closestEdge + 1) % contour.size()];
+            bool isContourPoint = (point.x == a.x && point.y == a.y) || (point.x == b.x && point.y == b.y);
+            if (!isContourPoint && closestDistance <= a.distanceTo(b) * ON_CONTOUR_TOLERANCE) {
+                contour.insert(contour.begin() + closestEdge + 1, point);
+            }
+        }
+    }
+
+    vector<TriangulatePoint> points;
+    vector<TriangulateSegment> segments;
+    vector<TriangulateRegion> regions;
+    std::map<std::pair<double, double>, int> indices;
+
+    vector<int> contourIndices;
+    for (auto point : contour) {
+        int marker = gamma2.hasVertexOnContour(point)
+                ? intcalc::Mesh::BoundaryMarker::GAMMA_2_BOUNDARY
+                : intcalc::Mesh::BoundaryMarker::GAMMA_1_BOUNDARY;
+        contourIndices.push_back(addPoint(points, indices, point, marker));
+    }
+    for (int i = 0; i < contour.size(); i++) {
+        int next = (i + 1) % contour.size();
+        TriangulateSegment segment;
+        segment.a = contourIndices[i];
+        segment.b = contourIndices[next];
+        segment.marker = gamma2.hasLineOnContour(contour[i], contour[next])
+                ? intcalc::Mesh::BoundaryMarker::GAMMA_2_BOUNDARY
+                : intcalc::Mesh::BoundaryMarker::GAMMA_1_BOUNDARY;
+        segments.push_back(segment);
+    }
+
+    for (int i = 0; i < areas.size(); i++) {
+        // segments outside of the region of study would keep the triangle
+        // library from removing the triangles there, those areas are
+        // classified geometrically instead
+        if (!isInsideRegion(areas[i], regionOfStudy)) {
+            continue;
+        }
+        const QVector<intcalc::Vector2d>* areaPoints = areas[i].points();
+        const int size = contourSize(areaPoints);
+        vector<int> areaIndices;
+        for (int j = 0; j < size; j++) {
+            areaIndices.push_back(addPoint(points, indices, areaPoints->at(j), intcalc::Mesh::BoundaryMarker::NO_BOUNDARY));
+        }
+        for (int j = 0; j < size; j++) {
+            TriangulateSegment segment;
+            segment.a = areaIndices[j];
+            segment.b = areaIndices[(j + 1) % size];
+            segment.marker = intcalc::Mesh::BoundaryMarker::NO_BOUNDARY;
+            segments.push_back(segment);
+        }
+
+        intcalc::Vector2d seed;
+        if (conformingAreas[i] && findInteriorPoint(areas[i], seed)) {
+            TriangulateRegion region;
+            region.x = seed.x;
+            region.y = seed.y;
+            region.attribute = i + 1;
+            region.maxArea = -1;
+            regions.push_back(region);
+        }
+    }
+
+    INTCALC_TRACE_SCOPE("triangulate");
+    Triangulate triangulate;
+    std::string switches = triangulationSwitches.toStdString();
+    return triangulate.triangulate(&switches[0], points, segments, regions);
+}
+
+triangulateio intcalc_utils::refineTriangulation(QString refinementSwitches,
+                                                 const intcalc::Mesh& mesh,
+                                                 const vector<double>& maxAreas) {
+    INTCALC_TRACE_SCOPE("refineTriangulation");
+    // only the corners are passed on, the midpoints of quadratic
+    // triangles are added again by the refinement switches
+    vector<int> pointIndex(mesh.verticesCount(), -1);
+    for (int i = 0; i < mesh.trianglesCount(); i++) {
+        for (int k = 0; k < 3; k++) {
+            pointIndex[mesh.triangle(i)[k]] = 0;
+        }
+    }
+    vector<TriangulatePoint> points;
+    for (int i = 0; i < mesh.verticesCount(); i++) {
+        if (pointIndex[i] < 0) {
+            continue;
+        }
+        pointIndex[i] = static_cast<int>(points.size());
+        points.push_back(TriangulatePoint());
+        TriangulatePoint& point = points.back();
+        point.x = mesh.x(i);
+        point.y = mesh.y(i);
+        switch (mesh.type(i)) {
+        case intcalc::VertexInfo::Type::GAMMA_1:
+            point.marker = intcalc::Mesh::BoundaryMarker::GAMMA_1_BOUNDARY;
+            break;
+        case intcalc::VertexInfo::Type::GAMMA_2:
+            point.marker = intcalc::Mesh::BoundaryMarker::GAMMA_2_BOUNDARY;
+            break;
+        default:
+            point.marker = intcalc::Mesh::BoundaryMarker::NO_BOUNDARY;
+        }
+    }
+
+    vector<int> triangles(mesh.trianglesCount() * 3);
+    vector<double> triangleAttributes(mesh.trianglesCount());
+    for (int i = 0; i < mesh.trianglesCount(); i++) {
+        for (int k = 0; k < 3; k++) {
+            triangles[3 * i + k] = pointIndex[mesh.triangle(i)[k]];
+        }
+        triangleAttributes[i] = mesh.triangleRegion(i);
     }
+    vector<double> areas(maxAreas);
+
+    vector<TriangulateSegment> segments(mesh.segmentsCount());
+    for (int i = 0; i < mesh.segmentsCount(); i++) {
+        segments[i].a = pointIndex[mesh.segment(i)[0]];
+        segments[i].b = pointIndex[mesh.segment(i)[1]];
+        segments[i].marker = mesh.segmentMarker(i);
+    }
+
     Triangulate triangulate;
-    char* switchesArray = new char[triangulationSwitches.length()];
-    memcpy(switchesArray, triangulationSwitches.toStdString().c_str(), triangulationSwitches.length());
-    triangulateio result = triangulate.triangulate(switchesArray, triangulationIn);
-    delete[] switchesArray;
-    return result;
+    std::string switches = refinementSwitches.toStdString();
+    return triangulate.refine(&switches[0], points, triangles, triangleAttributes, areas, segments);
+}
+
+void intcalc_utils::freeTriangulation(triangulateio& out) {
+    free(out.pointlist);
+    free(out.pointattributelist);
+    free(out.pointmarkerlist);
+    free(out.trianglelist);
+    free(out.triangleattributelist);
+    free(out.neighborlist);
+    free(out.segmentlist);
+    free(out.segmentmarkerlist);
+    free(out.edgelist);
+    free(out.edgemarkerlist);
+    out.pointlist = nullptr;
+    out.pointattributelist = nullptr;
+    out.pointmarkerlist = nullptr;
+    out.trianglelist = nullptr;
+    out.triangleattributelist = nullptr;
+    out.neighborlist = nullptr;
+    out.segmentlist = nullptr;
+    out.segmentmarkerlist = nullptr;
+    out.edgelist = nullptr;
+    out.edgemarkerlist = nullptr;
+}
+
+// the sorted keys (smaller index in the high half) keep the first of each edge
+QVector<unsigned int> intcalc_utils::uniqueEdges(const QVector<unsigned int>& triangleIndices) {
+    vector<unsigned long long> keys;
+    keys.reserve(triangleIndices.size());
+    for (int i = 0; i + 2 < triangleIndices.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            const unsigned long long a = triangleIndices[i + k];
+            const unsigned long long b = triangleIndices[i + (k + 1) % 3];
+            keys.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    QVector<unsigned int> edges(static_cast<int>(keys.size()) * 2);
+    for (size_t i = 0; i < keys.size(); i++) {
+        edges[2 * i] = static_cast<unsigned int>(keys[i] >> 32);
+        edges[2 * i + 1] = static_cast<unsigned int>(keys[i] & 0xffffffffULL);
+    }
+    return edges;
+}
+
+long long intcalc_utils::peakResidentMemory() {
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+        return usage.ru_maxrss;
+#else
+        // kilobytes on linux
+        return usage.ru_maxrss * 1024LL;
+#endif
+    }
+#endif
+    return 0;
 }
 
 vector<int> intcalc_utils::filterTriPointsOnLine(vector<intcalc::Vector2d>* line, vector<int> triPoints, triangulateio out) {
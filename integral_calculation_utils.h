@@ -23,8 +23,40 @@ namespace intcalc_utils
     // Check if point b is on line ac
     bool onLine(intcalc::Vector2d a, intcalc::Vector2d b, intcalc::Vector2d c);
 
-    // wrapper function for triangulation
-    triangulateio doTriangulate(QString triangulationSwitches, intcalc::Region& regionOfStudy);
+    // wrapper function for triangulation, the region of study contour is split into
+    // gamma 1 and gamma 2 segments and the boundaries of the areas inside of it become
+    // segments as well; triangles inside the areas marked as conforming get the area
+    // index + 1 as regional attribute
+    triangulateio doTriangulate(QString triangulationSwitches,
+                                const intcalc::Region& regionOfStudy,
+                                const intcalc::Region& gamma2,
+                                const QVector<intcalc::Region>& areas,
+                                const vector<bool>& conformingAreas);
+
+    // refines the mesh with the 'r' switch, maxAreas holds the area limit of every
+    // triangle, -1 for those that stay as they are; segments, boundary markers
+    // and regional attributes of the mesh are kept
+    triangulateio refineTriangulation(QString refinementSwitches,
+                                      const intcalc::Mesh& mesh,
+                                      const vector<double>& maxAreas);
+
+    // true if the closed area is strictly inside of the closed region,
+    // the contours don't cross or touch
+    bool isInsideRegion(const intcalc::Region& area, const intcalc::Region& region);
+
+    // finds a point strictly inside of a closed region
+    bool findInteriorPoint(const intcalc::Region& region, intcalc::Vector2d& point);
+
+    // release every buffer the triangle library allocated in out
+    void freeTriangulation(triangulateio& out);
+
+    // every edge of the triangles once as a pair of vertex indices,
+    // edges shared by two triangles are not repeated
+    QVector<unsigned int> uniqueEdges(const QVector<unsigned int>& triangleIndices);
+
+    // high-water mark of the resident memory of the whole process in bytes,
+    // 0 where the platform doesn't report it
+    long long peakResidentMemory();
 
     // remove those points from triPoints that are on the line
     vector<int> filterTriPointsOnLine(vector<intcalc::Vector2d>* line, vector<int> triPoints, triangulateio out);
@@ -1,47 +1,11 @@
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
-#include <QtMessageHandler>
-#include <QDateTime>
+#include <QThreadPool>
 #include <QDebug>
 
 #include "calculationresult_component.h"
-
-QObject* messageBoxTextEdit;
-
-void myMessageOutput(QtMsgType type, const QMessageLogContext& context, const QString& message)
-{
-    Q_UNUSED(context)
-
-    QString dateTime = QDateTime::currentDateTime().toString("dd.MM.yyyy hh:mm:ss");
-    QString logType;
-    QString baseFormat = "<code style=\"%4\">%1 [%2] %3</code>\n";
-    QString finalMessage;
-
-    switch (type) {
-    case QtDebugMsg:
-        logType = "DEBUG";
-        finalMessage = QString(baseFormat).arg(dateTime, logType, message, "");
-        break;
-    case QtInfoMsg:
-        logType = "INFO";
-        finalMessage = QString(baseFormat).arg(dateTime, logType, message, "");
-        break;
-    case QtWarningMsg:
-        logType = "WARNING";
-        finalMessage = QString(baseFormat).arg(dateTime, logType, message, "color: orange");
-        break;
-    case QtCriticalMsg:
-        logType = "CRITICAL";
-        finalMessage = QString(baseFormat).arg(dateTime, logType, message, "color: red");
-        break;
-    case QtFatalMsg:
-        logType = "FATAL";
-        finalMessage = QString(baseFormat).arg(dateTime, logType, message, "color: red");
-        break;
-    }
-    QMetaObject::invokeMethod(messageBoxTextEdit, "append", Q_ARG(QString, finalMessage));
-}
-
+#include "integral_calculation_trace.h"
+#include "message_log_sink.h"
 
 int main(int argc, char *argv[]) {
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
@@ -50,24 +14,40 @@ int main(int argc, char *argv[]) {
 
     qmlRegisterType<CalculationResultComponent>("lnu.oles.CalculationResult", 1, 0, "CalculationResult");
 
-    QQmlApplicationEngine engine;
+    // declared before the engine, so it outlives the calculations the engine started
+    MessageLogSink logSink;
+    const QString logFile = QString::fromLocal8Bit(qgetenv("INTCALC_LOG_FILE"));
+    if (!logFile.isEmpty() && !logSink.setFileSink(logFile)) {
+        qWarning() << "Can't open log file" << logFile;
+    }
+
+    int result = 0;
+    {
+        QQmlApplicationEngine engine;
 
-    const QUrl url(QStringLiteral("qrc:/main.qml"));
+        const QUrl url(QStringLiteral("qrc:/main.qml"));
 
-    QObject::connect(&engine,
-                     &QQmlApplicationEngine::objectCreated,
-                     &app,
-                     [url](QObject *obj, const QUrl &objUrl) {
-                         if (!obj && url == objUrl) {
-                             QCoreApplication::exit(-1);
-                         }
-                    },
-                    Qt::QueuedConnection);
+        QObject::connect(&engine,
+                         &QQmlApplicationEngine::objectCreated,
+                         &app,
+                         [url](QObject *obj, const QUrl &objUrl) {
+                             if (!obj && url == objUrl) {
+                                 QCoreApplication::exit(-1);
+                             }
+                        },
+                        Qt::QueuedConnection);
 
-    engine.load(url);
+        engine.load(url);
 
-    messageBoxTextEdit = engine.rootObjects().first()->findChild<QObject*>("messageBoxTextEdit");
-    qInstallMessageHandler(myMessageOutput);
+        logSink.setTextEdit(engine.rootObjects().first()->findChild<QObject*>("messageBoxTextEdit"));
+        logSink.install();
+
+        result = app.exec();
+    }
 
-    return app.exec();
+    // the engine cancelled the running calculations, but a direct
+    // factorization doesn't stop early and keeps logging until it returns
+    QThreadPool::globalInstance()->waitForDone();
+    INTCALC_TRACE_FINISH();
+    return result;
 }
@@ -20,6 +20,9 @@ ApplicationWindow {
             id: controlPanel
             readyToCalculate: map.dataReadyForCalculation;
             regionSelected: map.currentPolyline != regionOfStudy && map.currentPolyline != gamma2
+            calculating: calculationResult.calculating
+            calculationProgress: calculationResult.progress
+            calculationPhase: calculationResult.progressPhase
 
             SplitView.preferredWidth: 215
             SplitView.minimumWidth: 215
@@ -31,6 +34,9 @@ ApplicationWindow {
             onCalculate: function() {
                 map.triggerCalculation();
             }
+            onCancel: function() {
+                calculationResult.cancelCalculation();
+            }
             subregionSelectionChangedCallback: function() {
                 map.resetSubregion();
             }
@@ -70,6 +76,10 @@ ApplicationWindow {
                     calculationResult.updateDimensions();
                 }
 
+                onZoomLevelChanged: {
+                    calculationResult.updateDimensions();
+                }
+
                 RegionOfStudy {
                     id: regionOfStudy
                     line {
@@ -96,29 +106,28 @@ ApplicationWindow {
                     yy: controlPanel.windY;
                 }
 
-                MapQuickItem {
-                    id: calcMapItem
-                    zoomLevel: map.zoomLevel
-                    sourceItem: Rectangle {
-                        color: Qt.rgba(0, 0, 0, 0);
-                        CalculationResultWrapper {
-                            id: calculationResult
-                            anchors.fill: parent
-                            map: map
-                            regionOfStudy: regionOfStudy
-                            gamma2: gamma2
-                            conservacyAreas: map.omegaPolylines
-                            polutionSourceRegions: map.polutionSourceRegions
-                            triMinAngle: controlPanel.triMinAngle
-                            triMaxArea: controlPanel.triMaxArea
-                            showTriangulation: controlPanel.showTriangulation
-                            calculateGamma2: controlPanel.calculateGamma2
-                            windX: controlPanel.windX
-                            windY: controlPanel.windY
-                            mu: controlPanel.mu
-                            sigma: controlPanel.sigma
-                            alpha: controlPanel.alpha
-                        }
+                CalculationResultWrapper {
+                    id: calculationResult
+                    anchors.fill: parent
+                    map: map
+                    regionOfStudy: regionOfStudy
+                    gamma2: gamma2
+                    conservacyAreas: map.omegaPolylines
+                    polutionSourceRegions: map.polutionSourceRegions
+                    triMinAngle: controlPanel.triMinAngle
+                    triMaxArea: controlPanel.triMaxArea
+                    showTriangulation: controlPanel.showTriangulation
+                    colormap: controlPanel.colormap
+                    colorGamma: controlPanel.colorGamma
+                    calculateGamma2: controlPanel.calculateGamma2
+                    windX: controlPanel.windX
+                    windY: controlPanel.windY
+                    mu: controlPanel.mu
+                    sigma: controlPanel.sigma
+                    alpha: controlPanel.alpha
+
+                    onCalculationFinished: {
+                        map.showMinPoints(minPoints);
                     }
                 }
 
@@ -194,6 +203,7 @@ ApplicationWindow {
                     }
 
                     currentPolyline = regionOfStudy;
+                    calculationResult.cancelCalculation();
                     calculationResult.clear();
 
                     circles.forEach(circle => circle.hide());
@@ -203,7 +213,11 @@ ApplicationWindow {
                     if (!dataReadyForCalculation) {
                         return;
                     }
-                    var minPoints = calculationResult.calculate();
+                    calculationResult.calculate();
+                }
+
+                function showMinPoints(minPoints) {
+                    circles.forEach(circle => circle.hide());
                     for (var i = 0; i < Math.min(minPoints.length, circlesAmount); i++) {
                         circles[i].show(minPoints[i]);
                     }
@@ -0,0 +1,205 @@
+#include "message_log_sink.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <QDateTime>
+#include <QStringList>
+
+std::atomic<MessageLogSink*> MessageLogSink::_installed(nullptr);
+
+namespace {
+    const char* typeName(QtMsgType type) {
+        switch (type) {
+        case QtDebugMsg:
+            return "DEBUG";
+        case QtInfoMsg:
+            return "INFO";
+        case QtWarningMsg:
+            return "WARNING";
+        case QtCriticalMsg:
+            return "CRITICAL";
+        case QtFatalMsg:
+            return "FATAL";
+        }
+        return "";
+    }
+
+    const char* typeStyle(QtMsgType type) {
+        switch (type) {
+        case QtWarningMsg:
+            return "color: orange";
+        case QtCriticalMsg:
+        case QtFatalMsg:
+            return "color: red";
+        default:
+            return "";
+        }
+    }
+
+    QString formatTime(qint64 time) {
+        return QDateTime::fromMSecsSinceEpoch(time).toString("dd.MM.yyyy hh:mm:ss");
+    }
+}
+
+MessageLogSink::MessageLogSink(int capacity, QObject* parent)
+    : QObject(parent),
+      _enqueuePosition(0),
+      _dequeuePosition(0),
+      _dropped(0),
+      _reportedDropped(0) {
+    size_t size = 2;
+    while (size < static_cast<size_t>(capacity)) {
+        size *= 2;
+    }
+    _entries.reset(new Entry[size]);
+    _mask = size - 1;
+    for (size_t i = 0; i < size; i++) {
+        _entries[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // at most 10 updates of the message box per second
+    _timer.setInterval(100);
+    connect(&_timer, &QTimer::timeout, this, &MessageLogSink::drain);
+}
+
+MessageLogSink::~MessageLogSink() {
+    _timer.stop();
+    MessageLogSink* self = this;
+    if (_installed.compare_exchange_strong(self, nullptr)) {
+        qInstallMessageHandler(nullptr);
+    }
+    // the message box is usually gone by now, the rest goes to the file only
+    _textEdit = nullptr;
+    drain();
+}
+
+void MessageLogSink::setTextEdit(QObject* textEdit) {
+    _textEdit = textEdit;
+}
+
+bool MessageLogSink::setFileSink(const QString& fileName) {
+    _file.close();
+    _file.setFileName(fileName);
+    return _file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text);
+}
+
+void MessageLogSink::setDrainInterval(int ms) {
+    _timer.setInterval(ms);
+}
+
+void MessageLogSink::install() {
+    _installed.store(this);
+    qInstallMessageHandler(messageHandler);
+    _timer.start();
+}
+
+int MessageLogSink::dropped() const {
+    return _dropped.load(std::memory_order_relaxed);
+}
+
+void MessageLogSink::messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message) {
+    Q_UNUSED(context)
+
+    MessageLogSink* sink = _installed.load(std::memory_order_acquire);
+    if (sink == nullptr) {
+        return;
+    }
+    // the application aborts right after a fatal message, there is no drain
+    if (type == QtFatalMsg) {
+        sink->writeDirectly(type, message);
+        return;
+    }
+    if (!sink->push(type, message)) {
+        sink->_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// bounded multi producer queue, every slot has a sequence number that tells
+// whether it is free for the position a producer has claimed
+bool MessageLogSink::push(QtMsgType type, const QString& message) {
+    size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    Entry* entry;
+    for (;;) {
+        entry = &_entries[position & _mask];
+        const size_t sequence = entry->sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // full, the GUI thread is behind
+            return false;
+        } else {
+            position = _enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    entry->type = type;
+    entry->time = QDateTime::currentMSecsSinceEpoch();
+    entry->message = message;
+    entry->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool MessageLogSink::pop(QtMsgType& type, qint64& time, QString& message) {
+    Entry* entry = &_entries[_dequeuePosition & _mask];
+    const size_t sequence = entry->sequence.load(std::memory_order_acquire);
+    if (sequence != _dequeuePosition + 1) {
+        return false;
+    }
+
+    type = entry->type;
+    time = entry->time;
+    message = std::move(entry->message);
+    entry->message = QString();
+    entry->sequence.store(_dequeuePosition + _mask + 1, std::memory_order_release);
+    _dequeuePosition++;
+    return true;
+}
+
+void MessageLogSink::drain() {
+    const bool toTextEdit = !_textEdit.isNull();
+    const QString baseFormat = "<code style=\"%4\">%1 [%2] %3</code>";
+    QStringList lines;
+
+    QtMsgType type;
+    qint64 time;
+    QString message;
+    while ((!toTextEdit || lines.size() < MAX_LINES_PER_DRAIN) && pop(type, time, message)) {
+        const QString dateTime = formatTime(time);
+        if (_file.isOpen()) {
+            _file.write(QString("%1 [%2] %3\n").arg(dateTime, typeName(type), message).toUtf8());
+        }
+        if (toTextEdit) {
+            lines.push_back(baseFormat.arg(dateTime, typeName(type), message.toHtmlEscaped(), typeStyle(type)));
+        }
+    }
+
+    const int dropped = _dropped.load(std::memory_order_relaxed);
+    if (dropped != _reportedDropped) {
+        const QString note = QString("%1 log messages dropped").arg(dropped - _reportedDropped);
+        _reportedDropped = dropped;
+        if (_file.isOpen()) {
+            _file.write(QString("%1 [WARNING] %2\n").arg(formatTime(QDateTime::currentMSecsSinceEpoch()), note).toUtf8());
+        }
+        if (toTextEdit) {
+            lines.push_back(baseFormat.arg(formatTime(QDateTime::currentMSecsSinceEpoch()), "WARNING", note, "color: orange"));
+        }
+    }
+
+    if (_file.isOpen()) {
+        _file.flush();
+    }
+    if (!lines.isEmpty()) {
+        QMetaObject::invokeMethod(_textEdit, "append", Q_ARG(QString, lines.join("<br>")));
+    }
+}
+
+void MessageLogSink::writeDirectly(QtMsgType type, const QString& message) {
+    const QByteArray line = QString("%1 [%2] %3\n")
+            .arg(formatTime(QDateTime::currentMSecsSinceEpoch()), typeName(type), message)
+            .toLocal8Bit();
+    fputs(line.constData(), stderr);
+    fflush(stderr);
+}
@@ -0,0 +1,70 @@
+#ifndef MESSAGE_LOG_SINK_H
+#define MESSAGE_LOG_SINK_H
+
+#include <atomic>
+#include <memory>
+#include <QFile>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+#include <QtMessageHandler>
+
+// Qt message handler that never blocks the logging thread. Messages go to a
+// bounded lock-free ring buffer, the GUI thread drains it on a timer and
+// appends them to the message box in one batch, and to the file sink if set.
+// When the buffer is full new messages are dropped and counted.
+class MessageLogSink : public QObject {
+    Q_OBJECT
+
+public:
+    // capacity is rounded up to a power of two
+    explicit MessageLogSink(int capacity = 4096, QObject* parent = nullptr);
+    ~MessageLogSink();
+
+    // object with an append(QString) method, e.g. a rich text TextEdit
+    void setTextEdit(QObject* textEdit);
+    // returns false if the file can't be opened
+    bool setFileSink(const QString& fileName);
+    void setDrainInterval(int ms);
+
+    // makes this sink the Qt message handler, only one sink can be installed
+    void install();
+
+    int dropped() const;
+
+public slots:
+    void drain();
+
+private:
+    struct Entry {
+        std::atomic<size_t> sequence;
+        QtMsgType type;
+        qint64 time;
+        QString message;
+    };
+
+    // lines appended to the message box per drain, the rest waits for the next one
+    static const int MAX_LINES_PER_DRAIN = 200;
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext& context, const QString& message);
+    static std::atomic<MessageLogSink*> _installed;
+
+    bool push(QtMsgType type, const QString& message);
+    bool pop(QtMsgType& type, qint64& time, QString& message);
+    void writeDirectly(QtMsgType type, const QString& message);
+
+    std::unique_ptr<Entry[]> _entries;
+    size_t _mask;
+    std::atomic<size_t> _enqueuePosition;
+    // only the GUI thread dequeues
+    size_t _dequeuePosition;
+    std::atomic<int> _dropped;
+    int _reportedDropped;
+
+    QTimer _timer;
+    QPointer<QObject> _textEdit;
+    QFile _file;
+};
+
+#endif // MESSAGE_LOG_SINK_H
@@ -1,6 +1,18 @@
-varying mediump vec4 color;
+uniform sampler2D colormap;
+uniform mediump float gamma;
+uniform mediump vec4 lineColor;
+uniform bool drawLines;
+varying mediump float colorPosition;
+
+// centers of the first and the last of the 256 texels
+const mediump float COLORMAP_SCALE = 255.0 / 256.0;
+const mediump float COLORMAP_OFFSET = 0.5 / 256.0;
 
 void main(void)
 {
-    gl_FragColor = color;
+    if (drawLines) {
+        gl_FragColor = lineColor;
+    } else {
+        gl_FragColor = texture2D(colormap, vec2(pow(colorPosition, gamma) * COLORMAP_SCALE + COLORMAP_OFFSET, 0.5));
+    }
 }
@@ -1,9 +1,15 @@
-attribute highp vec4 vertex;
-attribute mediump vec4 custom_color;
-varying mediump vec4 color;
+attribute highp vec2 vertex;
+attribute highp float value;
+// west and south of the area covered by the item relative to the solution
+// bounds, 2 / width and 2 / height of the area
+uniform highp vec4 bounds;
+// value at the start of the colormap and 1 / (end - start)
+uniform highp vec2 valueRange;
+varying mediump float colorPosition;
 
 void main(void)
 {
-    color = custom_color;
-    gl_Position = vec4(vertex.x, -vertex.y, vertex.z, vertex.w);
+    colorPosition = clamp((value - valueRange.x) * valueRange.y, 0.0, 1.0);
+    highp vec2 position = (vertex - bounds.xy) * bounds.zw - 1.0;
+    gl_Position = vec4(position.x, -position.y, 0.0, 1.0);
 }
@@ -0,0 +1,241 @@
+#include <math.h>
+#include <algorithm>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QTextStream>
+
+#include "integral_calculation.h"
+#include "integral_calculation_utils.h"
+
+// Checks that the fused element kernel assembles the same global matrix M as
+// the m_ij reference path, on meshes with and without Robin (gamma 2) edges
+// and for different amounts of assembly threads. A smooth case is solved on
+// refined meshes, its solution must not change with the mesh. Exits with the
+// number of failed checks, qmake's make check runs it.
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    // the kernels sum the terms of an entry in a different order
+    const double KERNEL_TOLERANCE = 0.0000000001;
+
+    // the solution of a smooth case on a finer mesh differs by the discretization error only
+    const double REFINEMENT_TOLERANCE = 0.03;
+
+    int failures = 0;
+
+    void check(bool condition, const QString& name, const QString& message) {
+        QTextStream out(stdout);
+        if (!condition) {
+            out << "FAIL " << name << ": " << message << "\n";
+            failures++;
+        } else {
+            out << "ok   " << name << "\n";
+        }
+    }
+
+    struct Geometry {
+        QString name;
+        QVector<intcalc::Vector2d> regionOfStudy;
+        QVector<intcalc::Vector2d> gamma2;
+        QVector<intcalc::Vector2d> area;
+        QVector<intcalc::Vector2d> source;
+    };
+
+    QVector<intcalc::Vector2d> polygon(double cx, double cy, double radius, int vertices) {
+        QVector<intcalc::Vector2d> points;
+        for (int i = 0; i < vertices; i++) {
+            const double angle = 2 * PI * i / vertices;
+            const double r = radius * (1 + 0.1 * sin(7 * angle));
+            points.push_back(intcalc::Vector2d(cx + r * cos(angle), cy + r * sin(angle)));
+        }
+        points.push_back(points.first());
+        return points;
+    }
+
+    // unit square sheared, so no edge is axis aligned
+    intcalc::Vector2d sheared(double u, double v) {
+        return intcalc::Vector2d(u + 0.1 * v, 0.15 * u + v);
+    }
+
+    // only gamma 1, no boundary integrals
+    Geometry dirichletQuad() {
+        Geometry geometry;
+        geometry.name = "quad without gamma 2";
+        geometry.regionOfStudy = { sheared(0, 0), sheared(1, 0), sheared(1, 1), sheared(0, 1), sheared(0, 0) };
+        return geometry;
+    }
+
+    // a large conservation area, the solution is smooth
+    Geometry smoothQuad() {
+        Geometry geometry = dirichletQuad();
+        geometry.name = "quad with a large area";
+        geometry.area = polygon(0.55, 0.57, 0.35, 32);
+        return geometry;
+    }
+
+    // gamma 2 on the bottom and the right edge
+    Geometry robinQuad() {
+        Geometry geometry = dirichletQuad();
+        geometry.name = "quad with gamma 2";
+        geometry.gamma2 = { sheared(0, 0), sheared(1, 0), sheared(1, 1) };
+        geometry.area = polygon(0.7, 0.4, 0.15, 5);
+        return geometry;
+    }
+
+    // star shaped contour with gamma 2 on its first quarter, a conservation
+    // area and a polution source region, like the benchmark cases
+    Geometry robinStar() {
+        Geometry geometry;
+        geometry.name = "star with gamma 2 and areas";
+        geometry.regionOfStudy = polygon(0, 0, 1, 64);
+        geometry.gamma2 = geometry.regionOfStudy.mid(0, 17);
+        geometry.area = polygon(0.4, 0.1, 0.2, 16);
+        geometry.source = polygon(-0.4, -0.1, 0.2, 16);
+        return geometry;
+    }
+
+    // the calculator keeps pointers into geometry
+    void setUp(intcalc::FEMCalculator& calculator, Geometry& geometry, double alpha) {
+        calculator.setRegionOfStudy(&geometry.regionOfStudy);
+        calculator.setGamma2(&geometry.gamma2);
+        QVector<QVector<intcalc::Vector2d>*> areas;
+        if (!geometry.area.isEmpty()) {
+            areas.push_back(&geometry.area);
+        }
+        calculator.setConservacyAreas(areas);
+        QVector<QVector<intcalc::Vector2d>*> sources;
+        if (!geometry.source.isEmpty()) {
+            sources.push_back(&geometry.source);
+        }
+        calculator.setPolutionSourceRegions(sources);
+        calculator.setTriangulationOptions(20, 0.001);
+        calculator.setMu(1);
+        calculator.setSigma(0.5);
+        calculator.setAlpha(alpha);
+        calculator.setBeta(0.3, -0.2);
+        calculator.setUseMeshCache(false);
+    }
+
+    intcalc::SparseMatrix assemble(Geometry& geometry,
+                                   intcalc::FEMCalculator::AssemblyKernel kernel,
+                                   int threads,
+                                   double alpha,
+                                   int* usedThreads = nullptr) {
+        intcalc::FEMCalculator calculator;
+        setUp(calculator, geometry, alpha);
+        calculator.setAssemblyKernel(kernel);
+        calculator.setAssemblyThreads(threads);
+        // the test meshes are small, split them anyway
+        calculator.setMinTrianglesPerThread(1);
+        const intcalc::SparseMatrix result = calculator.assembleGlobalMatrix();
+        if (usedThreads != nullptr) {
+            *usedThreads = calculator.usedAssemblyThreads();
+        }
+        return result;
+    }
+
+    double maxAbs(const intcalc::SparseMatrix& a) {
+        double result = 0.0;
+        for (int k = 0; k < a.nonZeros(); k++) {
+            result = std::max(result, fabs(a.valuePtr()[k]));
+        }
+        return result;
+    }
+
+    void compareKernels(Geometry geometry, int threads) {
+        const QString name = QString("%0, %1 threads").arg(geometry.name).arg(threads);
+        const intcalc::SparseMatrix reference = assemble(geometry, intcalc::FEMCalculator::REFERENCE, 1, 2);
+        int usedThreads = 0;
+        const intcalc::SparseMatrix fused = assemble(geometry, intcalc::FEMCalculator::FUSED, threads, 2, &usedThreads);
+
+        check(reference.rows() > 0, name + ": mesh", "has no vertices");
+        check(usedThreads == threads, name + ": threads",
+              QString("assembled on %0 threads").arg(usedThreads));
+        check(reference.rows() == fused.rows() && reference.nonZeros() == fused.nonZeros(),
+              name + ": pattern",
+              QString("%0 nonzeros != %1").arg(fused.nonZeros()).arg(reference.nonZeros()));
+        if (reference.rows() != fused.rows()) {
+            return;
+        }
+        const double difference = maxAbs(fused - reference);
+        check(difference <= KERNEL_TOLERANCE * maxAbs(reference),
+              name + ": values",
+              QString("max difference %0").arg(difference));
+    }
+
+    // alpha only enters M through the boundary integrals
+    void checkRobinEdges(Geometry geometry, bool expected) {
+        const intcalc::SparseMatrix withoutRobin = assemble(geometry, intcalc::FEMCalculator::FUSED, 1, 0);
+        const intcalc::SparseMatrix withRobin = assemble(geometry, intcalc::FEMCalculator::FUSED, 1, 2);
+        const bool hasRobinTerms = maxAbs(withRobin - withoutRobin) > 0;
+        check(hasRobinTerms == expected,
+              geometry.name + ": gamma 2 edges",
+              expected ? "no boundary integrals assembled" : "unexpected boundary integrals");
+    }
+
+    // the wireframe of a triangulation without holes has V + T - 1 edges
+    void checkWireframeEdges(Geometry geometry) {
+        intcalc::FEMCalculator calculator;
+        setUp(calculator, geometry, 2);
+        const intcalc::CalcSolution solution = calculator.solve();
+        const intcalc::SolutionData& data = *solution.data;
+        const QVector<unsigned int> edges = intcalc_utils::uniqueEdges(data.indices);
+        check(edges.size() / 2 == data.verticesCount() + data.trianglesCount() - 1,
+              geometry.name + ": wireframe edges",
+              QString("%0 edges for %1 vertices and %2 triangles")
+                  .arg(edges.size() / 2).arg(data.verticesCount()).arg(data.trianglesCount()));
+    }
+
+    double maximum(Geometry geometry, double maxArea, int refinements) {
+        intcalc::FEMCalculator calculator;
+        setUp(calculator, geometry, 2);
+        calculator.setTriangulationOptions(20, maxArea);
+        intcalc::AdaptiveRefinementOptions options;
+        options.maxIterations = refinements;
+        options.tolerance = 0;
+        calculator.setAdaptiveRefinement(options);
+        const intcalc::CalcSolution solution = calculator.solve();
+        return solution.data->maxValue;
+    }
+
+    // the load is the integral over the conservation area, so a finer mesh,
+    // uniform or adaptive, approximates the same solution; a load that grows
+    // with the vertices would grow the solution with them
+    void checkRefinement(Geometry geometry) {
+        const double coarse = maximum(geometry, 0.001, 0);
+        const double fine = maximum(geometry, 0.00025, 0);
+        const double refined = maximum(geometry, 0.001, 2);
+        check(coarse > 0 && fabs(fine - coarse) <= REFINEMENT_TOLERANCE * coarse,
+              geometry.name + ": uniform refinement",
+              QString("maximum %0 on the fine mesh, %1 on the coarse one").arg(fine).arg(coarse));
+        check(fabs(refined - coarse) <= REFINEMENT_TOLERANCE * coarse,
+              geometry.name + ": adaptive refinement",
+              QString("maximum %0 after refinement, %1 before").arg(refined).arg(coarse));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("intcalc_tests");
+    QLoggingCategory::setFilterRules("default.info=false");
+
+    try {
+        checkRobinEdges(dirichletQuad(), false);
+        checkRobinEdges(robinQuad(), true);
+        checkRobinEdges(robinStar(), true);
+        checkWireframeEdges(robinStar());
+        checkRefinement(smoothQuad());
+        for (int threads : { 1, 4 }) {
+            compareKernels(dirichletQuad(), threads);
+            compareKernels(robinQuad(), threads);
+            compareKernels(robinStar(), threads);
+        }
+    } catch (const char* e) {
+        qCritical() << "Failed:" << e;
+        return 1;
+    }
+
+    return failures;
+}
@@ -1,20 +1,80 @@
 #include "triangle_gradient_renderer.h"
 
-TriangleGradientRenderer::TriangleGradientRenderer(
-        QVector<QVector2D>* vertices,
-        QVector<QVector4D>* colors,
-        QVector<unsigned int>* indices,
-        bool* showTriangulation,
-        bool* dataChanged)
-    : vertices(vertices),
-      colors(colors),
-      indices(indices),
-      showTriangulation(showTriangulation),
-      dataChanged(dataChanged),
-      vao(new QOpenGLVertexArrayObject()),
-      vbov(new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer)),
-      vboc(new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer)),
-      ibo(new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer)) {
+#include <algorithm>
+
+#include "calculationresult_component.h"
+#include "integral_calculation_trace.h"
+#include "integral_calculation_utils.h"
+
+namespace {
+    struct ColorStop {
+        float position;
+        float r;
+        float g;
+        float b;
+    };
+
+    const ColorStop GRAYSCALE[] = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } };
+    const ColorStop HEAT[] = {
+        { 0.0f, 0.0f, 0.0f, 0.0f },
+        { 0.35f, 0.8f, 0.0f, 0.0f },
+        { 0.7f, 1.0f, 0.8f, 0.0f },
+        { 1.0f, 1.0f, 1.0f, 1.0f }
+    };
+    const ColorStop VIRIDIS[] = {
+        { 0.0f, 0.267f, 0.005f, 0.329f },
+        { 0.25f, 0.229f, 0.322f, 0.546f },
+        { 0.5f, 0.128f, 0.567f, 0.551f },
+        { 0.75f, 0.369f, 0.789f, 0.383f },
+        { 1.0f, 0.993f, 0.906f, 0.144f }
+    };
+
+    // a level is drawn while its cells are at most this many pixels wide
+    const double LOD_MAX_CELL_PIXELS = 2.0;
+
+    const int COLORMAP_SIZE = 256;
+    // the result is drawn over the map
+    const unsigned char COLORMAP_ALPHA = 204;
+
+    // stops interpolated into RGBA texels, unknown palettes are grayscale
+    QVector<unsigned char> colormapTexels(const QString& palette) {
+        const ColorStop* stops = GRAYSCALE;
+        int stopsCount = sizeof(GRAYSCALE) / sizeof(ColorStop);
+        if (palette == "heat") {
+            stops = HEAT;
+            stopsCount = sizeof(HEAT) / sizeof(ColorStop);
+        } else if (palette == "viridis") {
+            stops = VIRIDIS;
+            stopsCount = sizeof(VIRIDIS) / sizeof(ColorStop);
+        }
+
+        QVector<unsigned char> texels(COLORMAP_SIZE * 4);
+        int stop = 0;
+        for (int i = 0; i < COLORMAP_SIZE; i++) {
+            const float position = static_cast<float>(i) / (COLORMAP_SIZE - 1);
+            while (stop < stopsCount - 2 && stops[stop + 1].position < position) {
+                stop++;
+            }
+            const ColorStop& a = stops[stop];
+            const ColorStop& b = stops[stop + 1];
+            const float t = std::min(std::max((position - a.position) / (b.position - a.position), 0.0f), 1.0f);
+            texels[4 * i] = static_cast<unsigned char>(255 * (a.r + (b.r - a.r) * t) + 0.5f);
+            texels[4 * i + 1] = static_cast<unsigned char>(255 * (a.g + (b.g - a.g) * t) + 0.5f);
+            texels[4 * i + 2] = static_cast<unsigned char>(255 * (a.b + (b.b - a.b) * t) + 0.5f);
+            texels[4 * i + 3] = COLORMAP_ALPHA;
+        }
+        return texels;
+    }
+}
+
+TriangleGradientRenderer::TriangleGradientRenderer()
+    : showTriangulation(false),
+      hasViewBounds(false),
+      palette("grayscale"),
+      gamma(1.0f),
+      colorRangeMin(0.0f),
+      colorRangeMax(1.0f),
+      colormap(new QOpenGLTexture(QOpenGLTexture::Target2D)) {
 
     initializeOpenGLFunctions();
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
@@ -25,79 +85,212 @@ TriangleGradientRenderer::TriangleGradientRenderer(
     program.link();
 
     vertexAttribute = program.attributeLocation("vertex");
-    colorAttribute = program.attributeLocation("custom_color");
+    valueAttribute = program.attributeLocation("value");
+    boundsUniform = program.uniformLocation("bounds");
+    valueRangeUniform = program.uniformLocation("valueRange");
+    gammaUniform = program.uniformLocation("gamma");
+    colormapUniform = program.uniformLocation("colormap");
+    lineColorUniform = program.uniformLocation("lineColor");
+    drawLinesUniform = program.uniformLocation("drawLines");
 
-    vao->create();
-    vao->bind();
+    meshes.push_back(createMeshBuffers());
 
-    vbov->create();
-    vbov->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    vbov->bind();
+    // 1D lookup table as a texture of height 1, also available on GLES 2
+    colormap->setSize(COLORMAP_SIZE, 1);
+    colormap->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    colormap->allocateStorage();
+    colormap->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+    colormap->setWrapMode(QOpenGLTexture::ClampToEdge);
+    uploadColormap();
+}
+
+// the item is blocked while this runs, only the handle is copied;
+// every synchronize is followed by one render, so frames are counted here
+void TriangleGradientRenderer::synchronize(QQuickFramebufferObject* item) {
+    CalculationResultComponent* component = static_cast<CalculationResultComponent*>(item);
+    data = component->solutionData();
+    lodLevels = component->lodLevels();
+    showTriangulation = component->showTriangulation();
+    hasViewBounds = component->hasViewBounds();
+    viewBounds = component->viewBounds();
+    palette = component->colormap();
+    gamma = static_cast<float>(component->colorGamma());
+    colorRangeMin = static_cast<float>(component->colorRangeMin());
+    colorRangeMax = static_cast<float>(component->colorRangeMax());
+    component->_renderCount++;
+    QMetaObject::invokeMethod(component, "renderCountChanged", Qt::QueuedConnection);
+}
+
+TriangleGradientRenderer::MeshBuffers TriangleGradientRenderer::createMeshBuffers() {
+    MeshBuffers mesh;
+    mesh.vao = new QOpenGLVertexArrayObject();
+    mesh.vbov = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    mesh.vbovalue = new QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    mesh.ibo = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    mesh.edgesCount = -1;
+
+    program.bind();
+    mesh.vao->create();
+    mesh.vao->bind();
+
+    // positions relative to the solution bounds and values are
+    // uploaded as the floats of the solution data
+    mesh.vbov->create();
+    mesh.vbov->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    mesh.vbov->bind();
     program.enableAttributeArray(vertexAttribute);
     program.setAttributeBuffer(vertexAttribute, GL_FLOAT, 0, 2);
 
-    vboc->create();
-    vboc->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    vboc->bind();
-    program.enableAttributeArray(colorAttribute);
-    program.setAttributeBuffer(colorAttribute, GL_FLOAT, 0, 4);
+    mesh.vbovalue->create();
+    mesh.vbovalue->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    mesh.vbovalue->bind();
+    program.enableAttributeArray(valueAttribute);
+    program.setAttributeBuffer(valueAttribute, GL_FLOAT, 0, 1);
 
-    ibo->create();
-    ibo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-    ibo->bind();
+    mesh.ibo->create();
+    mesh.ibo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+    mesh.ibo->bind();
 
-    vao->release();
+    mesh.vao->release();
     program.release();
+    return mesh;
+}
+
+void TriangleGradientRenderer::deleteMeshBuffers(MeshBuffers& mesh) {
+    delete mesh.vao;
+    delete mesh.vbov;
+    delete mesh.vbovalue;
+    delete mesh.ibo;
+    mesh.data.reset();
+}
+
+void TriangleGradientRenderer::upload(MeshBuffers& mesh, const std::shared_ptr<const intcalc::SolutionData>& meshData) {
+    INTCALC_TRACE_SCOPE("upload");
+    mesh.vbov->bind();
+    mesh.vbov->allocate(meshData->positions.constData(), meshData->positions.size() * sizeof(float));
+    mesh.vbovalue->bind();
+    mesh.vbovalue->allocate(meshData->renderValues.constData(), meshData->renderValues.size() * sizeof(float));
+    mesh.ibo->bind();
+    mesh.ibo->allocate(meshData->indices.constData(), meshData->indices.size() * sizeof(unsigned int));
+    mesh.edgesCount = -1;
+    mesh.data = meshData;
+}
+
+// every edge once for GL_LINES, after the triangles in the same index
+// buffer; only built when the triangulation is shown for the first time
+void TriangleGradientRenderer::uploadEdges(MeshBuffers& mesh) {
+    INTCALC_TRACE_SCOPE("uploadEdges");
+    const QVector<unsigned int> edges = intcalc_utils::uniqueEdges(mesh.data->indices);
+    const int trianglesSize = mesh.data->indices.size() * sizeof(unsigned int);
+    const int edgesSize = edges.size() * sizeof(unsigned int);
+    mesh.ibo->bind();
+    mesh.ibo->allocate(trianglesSize + edgesSize);
+    mesh.ibo->write(0, mesh.data->indices.constData(), trianglesSize);
+    mesh.ibo->write(trianglesSize, edges.constData(), edgesSize);
+    mesh.edgesCount = edges.size();
+}
+
+// 0 is the full solution, the coarsest level whose cells
+// are still small on screen otherwise
+int TriangleGradientRenderer::selectLevel(double worldWidth) {
+    if (showTriangulation || lodLevels.isEmpty() || worldWidth <= 0) {
+        return 0;
+    }
+    const double pixelsPerUnit = framebufferObject()->width() / worldWidth;
+    int level = 0;
+    for (int i = 0; i < lodLevels.size(); i++) {
+        if (lodLevels[i].cellSize * pixelsPerUnit <= LOD_MAX_CELL_PIXELS) {
+            level = i + 1;
+        }
+    }
+    return level;
+}
+
+void TriangleGradientRenderer::uploadColormap() {
+    const QVector<unsigned char> texels = colormapTexels(palette);
+    colormap->setData(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, texels.constData());
+    uploadedPalette = palette;
 }
 
 void TriangleGradientRenderer::render() {
+    INTCALC_TRACE_SCOPE("render");
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // TODO: make async
-    if (*dataChanged) {
-        int verticesAmount = vertices->size();
-        vertices->reserve(verticesAmount * 2);
-        colors->reserve(verticesAmount * 2);
-        for (int i = 0; i < verticesAmount; i++) {
-            vertices->push_back(vertices->at(i));
-            colors->push_back(QVector4D(1.0f, 0.0f, 0.0f, 0.4f));
-        }
+    // buffers of levels from an older solution are dropped
+    while (meshes.size() > lodLevels.size() + 1) {
+        deleteMeshBuffers(meshes.last());
+        meshes.removeLast();
+    }
+    if (!data || data->indices.isEmpty()) {
+        return;
+    }
+    if (palette != uploadedPalette) {
+        uploadColormap();
+    }
 
-        int indicesAmount = indices->size();
-        indices->reserve(indicesAmount * 2);
-        for (int i = 0; i < indicesAmount; i++) {
-            indices->push_back(indices->at(i) + verticesAmount);
-        }
+    // world to clip transform, from the map when the component has it
+    double minX = data->minX;
+    double minY = data->minY;
+    double width = data->maxX - data->minX;
+    double height = data->maxY - data->minY;
+    if (hasViewBounds) {
+        minX = viewBounds.x();
+        minY = viewBounds.y();
+        width = viewBounds.width();
+        height = viewBounds.height();
+    }
 
-        vbov->bind();
-        vbov->allocate(vertices->constData(), vertices->size() * sizeof(QVector2D));
-        vboc->bind();
-        vboc->allocate(colors->constData(), colors->size() * sizeof(QVector4D));
-        ibo->bind();
-        ibo->allocate(indices->constData(), indices->size() * sizeof(unsigned int));
-        *dataChanged = false;
+    const int level = selectLevel(width);
+    const std::shared_ptr<const intcalc::SolutionData>& levelData = level == 0 ? data : lodLevels[level - 1].data;
+    while (meshes.size() <= level) {
+        meshes.push_back(createMeshBuffers());
+    }
+    MeshBuffers& mesh = meshes[level];
+    if (mesh.data != levelData) {
+        upload(mesh, levelData);
+    }
+    if (showTriangulation && mesh.edgesCount < 0) {
+        uploadEdges(mesh);
     }
 
-    program.bind();
-    vao->bind();
-    glDrawElements(GL_TRIANGLES, indices->size() / 2, GL_UNSIGNED_INT, 0);
-    if (*showTriangulation) {
-        for (int i = indices->size() / 2; i < indices->size(); i += 3) {
-            glDrawElements(GL_LINE_LOOP, 3, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * i));
+    {
+        INTCALC_TRACE_SCOPE("draw");
+        const float valueRange = colorRangeMax - colorRangeMin;
+        const int indicesCount = levelData->indices.size();
+
+        program.bind();
+        mesh.vao->bind();
+        // the vertices are relative to the solution bounds, the offset is
+        // taken in double so the floats only hold small differences
+        program.setUniformValue(boundsUniform,
+                                static_cast<float>(minX - levelData->minX),
+                                static_cast<float>(minY - levelData->minY),
+                                static_cast<float>(width != 0 ? 2 / width : 1.0),
+                                static_cast<float>(height != 0 ? 2 / height : 1.0));
+        program.setUniformValue(valueRangeUniform, colorRangeMin, valueRange != 0 ? 1 / valueRange : 1.0f);
+        program.setUniformValue(gammaUniform, gamma > 0 ? gamma : 1.0f);
+        colormap->bind(0);
+        program.setUniformValue(colormapUniform, 0);
+        program.setUniformValue(drawLinesUniform, false);
+        glDrawElements(GL_TRIANGLES, indicesCount, GL_UNSIGNED_INT, 0);
+        if (showTriangulation) {
+            program.setUniformValue(drawLinesUniform, true);
+            program.setUniformValue(lineColorUniform, QVector4D(1.0f, 0.0f, 0.0f, 0.4f));
+            glDrawElements(GL_LINES, mesh.edgesCount, GL_UNSIGNED_INT,
+                           (void*)(sizeof(unsigned int) * indicesCount));
         }
+        colormap->release();
+        mesh.vao->release();
+        program.release();
     }
-    vao->release();
-    program.release();
-
-    update();
 }
 
 TriangleGradientRenderer::~TriangleGradientRenderer() {
-    delete vao;
-    delete vbov;
-    delete vboc;
-    delete ibo;
+    for (MeshBuffers& mesh : meshes) {
+        deleteMeshBuffers(mesh);
+    }
+    delete colormap;
 }
 
 QOpenGLFramebufferObject* TriangleGradientRenderer::createFramebufferObject(const QSize &size) {
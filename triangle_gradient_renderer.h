@@ -1,44 +1,82 @@
 #ifndef CALCULATIONRESULTRENDERER_H
 #define CALCULATIONRESULTRENDERER_H
 
+#include <memory>
 #include <QQuickFramebufferObject>
 #include <QtGui/QOpenGLFramebufferObject>
 #include <QtGui/QOpenGLVertexArrayObject>
 #include <QtGui/QOpenGLBuffer>
+#include <QtGui/QOpenGLTexture>
 #include <QtGui/qopenglshaderprogram.h>
 #include <QtGui/qopenglfunctions.h>
 
+#include "integral_calculation.h"
+#include "integral_calculation_lod.h"
+
+// draws the solution of CalculationResultComponent, the buffers of the
+// solution are uploaded as they are and the values are mapped to colors
+// in the shader with a colormap texture; a frame is only rendered when
+// the component calls update(); zoomed out, a simplified level of the
+// solution is drawn instead, so triangles stay about a pixel in size
 class TriangleGradientRenderer : public QQuickFramebufferObject::Renderer, protected QOpenGLFunctions {
 public:
-    TriangleGradientRenderer(QVector<QVector2D>* vertices,
-                             QVector<QVector4D>* colors,
-                             QVector<unsigned int>* indices,
-                             bool* showTriangulation,
-                             bool* dataChanged);
+    TriangleGradientRenderer();
 
     ~TriangleGradientRenderer();
 
+    void synchronize(QQuickFramebufferObject* item) override;
+
     void render() override;
 
     QOpenGLFramebufferObject *createFramebufferObject(const QSize &size) override;
 
 private:
+    // buffers of one level, uploaded the first time the level is drawn
+    struct MeshBuffers {
+        std::shared_ptr<const intcalc::SolutionData> data;
+        QOpenGLVertexArrayObject* vao;
+        QOpenGLBuffer* vbov;
+        QOpenGLBuffer* vbovalue;
+        // triangles, followed by the wireframe edges once they are needed
+        QOpenGLBuffer* ibo;
+        // -1 until the edges are uploaded
+        int edgesCount;
+    };
+
     QString loadShaderFromFile(QString fileName);
+    MeshBuffers createMeshBuffers();
+    void deleteMeshBuffers(MeshBuffers& mesh);
+    void upload(MeshBuffers& mesh, const std::shared_ptr<const intcalc::SolutionData>& meshData);
+    void uploadEdges(MeshBuffers& mesh);
+    int selectLevel(double worldWidth);
+    void uploadColormap();
 
-    QVector<QVector2D>* vertices;
-    QVector<QVector4D>* colors;
-    QVector<unsigned int>* indices;
-    bool* showTriangulation;
-    bool* dataChanged;
+    // latest solution of the item and its levels,
+    // the renderer keeps its own reference while drawing
+    std::shared_ptr<const intcalc::SolutionData> data;
+    QVector<intcalc::LodLevel> lodLevels;
+    bool showTriangulation;
+    bool hasViewBounds;
+    QRectF viewBounds;
+    QString palette;
+    QString uploadedPalette;
+    float gamma;
+    float colorRangeMin;
+    float colorRangeMax;
 
     QOpenGLShaderProgram program;
-    QOpenGLVertexArrayObject* vao;
-    QOpenGLBuffer* vbov;
-    QOpenGLBuffer* vboc;
-    QOpenGLBuffer* ibo;
+    // the full solution first, then one per level
+    QVector<MeshBuffers> meshes;
+    QOpenGLTexture* colormap;
 
     int vertexAttribute;
-    int colorAttribute;
+    int valueAttribute;
+    int boundsUniform;
+    int valueRangeUniform;
+    int gammaUniform;
+    int colormapUniform;
+    int lineColorUniform;
+    int drawLinesUniform;
 };
 
 #endif
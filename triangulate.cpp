@@ -4,14 +4,25 @@ Triangulate::Triangulate() {
 }
 
 triangulateio Triangulate::triangulate(char* switches, vector<TriangulatePoint>& points) {
+    vector<TriangulateSegment> segments;
+    vector<TriangulateRegion> regions;
+    return triangulate(switches, points, segments, regions);
+}
+
+triangulateio Triangulate::triangulate(char* switches,
+                                       vector<TriangulatePoint>& points,
+                                       vector<TriangulateSegment>& segments,
+                                       vector<TriangulateRegion>& regions) {
     triangulateio in;
     triangulateio out;
 
     in.numberofpoints = (int) points.size();
     in.numberofpointattributes = 0;
-    in.numberofsegments = 0;
+    in.pointattributelist = nullptr;
+    in.numberofsegments = (int) segments.size();
     in.numberofholes = 0;
-    in.numberofregions = 0;
+    in.holelist = nullptr;
+    in.numberofregions = (int) regions.size();
     in.pointlist = new double[in.numberofpoints * 2];
     for (int i = 0; i < in.numberofpoints * 2; i += 2) {
         TriangulatePoint point = points.at(i / 2);
@@ -21,8 +32,100 @@ triangulateio Triangulate::triangulate(char* switches, vector<TriangulatePoint>&
 
     in.pointmarkerlist = new int[in.numberofpoints];
     for (int i = 0; i < in.numberofpoints; i++) {
-        in.pointmarkerlist[i] = 0;
+        in.pointmarkerlist[i] = points.at(i).marker;
+    }
+
+    in.segmentlist = new int[in.numberofsegments * 2];
+    in.segmentmarkerlist = new int[in.numberofsegments];
+    for (int i = 0; i < in.numberofsegments; i++) {
+        in.segmentlist[i * 2] = segments.at(i).a;
+        in.segmentlist[i * 2 + 1] = segments.at(i).b;
+        in.segmentmarkerlist[i] = segments.at(i).marker;
+    }
+
+    in.regionlist = new double[in.numberofregions * 4];
+    for (int i = 0; i < in.numberofregions; i++) {
+        in.regionlist[i * 4] = regions.at(i).x;
+        in.regionlist[i * 4 + 1] = regions.at(i).y;
+        in.regionlist[i * 4 + 2] = regions.at(i).attribute;
+        in.regionlist[i * 4 + 3] = regions.at(i).maxArea;
+    }
+
+    out.pointlist = nullptr;
+    out.pointattributelist = nullptr;
+    out.pointmarkerlist = nullptr;
+    out.trianglelist = nullptr;
+    out.triangleattributelist = nullptr;
+    out.neighborlist = nullptr;
+    out.segmentlist = nullptr;
+    out.segmentmarkerlist = nullptr;
+    out.edgelist = nullptr;
+    out.edgemarkerlist = nullptr;
+
+    ::triangulate(switches, &in, &out, nullptr);
+
+    delete[] in.pointlist;
+    delete[] in.pointmarkerlist;
+    delete[] in.segmentlist;
+    delete[] in.segmentmarkerlist;
+    delete[] in.regionlist;
+
+    // holes and regions are copied over from the input by reference
+    out.holelist = nullptr;
+    out.regionlist = nullptr;
+
+    return out;
+}
+
+triangulateio Triangulate::refine(char* switches,
+                                  vector<TriangulatePoint>& points,
+                                  vector<int>& triangles,
+                                  vector<double>& triangleAttributes,
+                                  vector<double>& maxAreas,
+                                  vector<TriangulateSegment>& segments) {
+    triangulateio in;
+    triangulateio out;
+
+    in.numberofpoints = (int) points.size();
+    in.numberofpointattributes = 0;
+    in.pointattributelist = nullptr;
+    in.pointlist = new double[in.numberofpoints * 2];
+    in.pointmarkerlist = new int[in.numberofpoints];
+    for (int i = 0; i < in.numberofpoints; i++) {
+        in.pointlist[i * 2] = points.at(i).x;
+        in.pointlist[i * 2 + 1] = points.at(i).y;
+        in.pointmarkerlist[i] = points.at(i).marker;
+    }
+
+    in.numberoftriangles = (int) maxAreas.size();
+    in.numberofcorners = 3;
+    in.numberoftriangleattributes = triangleAttributes.empty() ? 0 : 1;
+    in.trianglelist = new int[in.numberoftriangles * 3];
+    for (int i = 0; i < in.numberoftriangles * 3; i++) {
+        in.trianglelist[i] = triangles.at(i);
+    }
+    in.triangleattributelist = new double[triangleAttributes.size()];
+    for (unsigned int i = 0; i < triangleAttributes.size(); i++) {
+        in.triangleattributelist[i] = triangleAttributes.at(i);
+    }
+    in.trianglearealist = new double[in.numberoftriangles];
+    for (int i = 0; i < in.numberoftriangles; i++) {
+        in.trianglearealist[i] = maxAreas.at(i);
     }
+    in.neighborlist = nullptr;
+
+    in.numberofsegments = (int) segments.size();
+    in.segmentlist = new int[in.numberofsegments * 2];
+    in.segmentmarkerlist = new int[in.numberofsegments];
+    for (int i = 0; i < in.numberofsegments; i++) {
+        in.segmentlist[i * 2] = segments.at(i).a;
+        in.segmentlist[i * 2 + 1] = segments.at(i).b;
+        in.segmentmarkerlist[i] = segments.at(i).marker;
+    }
+    in.numberofholes = 0;
+    in.holelist = nullptr;
+    in.numberofregions = 0;
+    in.regionlist = nullptr;
 
     out.pointlist = nullptr;
     out.pointattributelist = nullptr;
@@ -37,8 +140,16 @@ triangulateio Triangulate::triangulate(char* switches, vector<TriangulatePoint>&
 
     ::triangulate(switches, &in, &out, nullptr);
 
-    free(in.pointlist);
-    free(in.pointmarkerlist);
+    delete[] in.pointlist;
+    delete[] in.pointmarkerlist;
+    delete[] in.trianglelist;
+    delete[] in.triangleattributelist;
+    delete[] in.trianglearealist;
+    delete[] in.segmentlist;
+    delete[] in.segmentmarkerlist;
+
+    out.holelist = nullptr;
+    out.regionlist = nullptr;
 
     return out;
 }
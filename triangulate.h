@@ -14,6 +14,22 @@ extern "C" {
 struct TriangulatePoint {
     double x;
     double y;
+    int marker;
+};
+
+// segment of the planar straight line graph, used with the 'p' switch
+struct TriangulateSegment {
+    int a;
+    int b;
+    int marker;
+};
+
+// seed point of a region, used with the 'A' and 'a' switches
+struct TriangulateRegion {
+    double x;
+    double y;
+    double attribute;
+    double maxArea;
 };
 
 class Triangulate {
@@ -21,6 +37,20 @@ public:
     Triangulate();
 
     triangulateio triangulate(char* switches, vector<TriangulatePoint>& points);
+    triangulateio triangulate(char* switches,
+                              vector<TriangulatePoint>& points,
+                              vector<TriangulateSegment>& segments,
+                              vector<TriangulateRegion>& regions);
+
+    // refines an existing triangulation, used with the 'r' switch; triangles
+    // are split until they are smaller than their entry in maxAreas, entries
+    // <= 0 don't limit the area. Triangles keep their attribute.
+    triangulateio refine(char* switches,
+                         vector<TriangulatePoint>& points,
+                         vector<int>& triangles,
+                         vector<double>& triangleAttributes,
+                         vector<double>& maxAreas,
+                         vector<TriangulateSegment>& segments);
 };
 
 #endif // TRIANGULATE_H